@@ -0,0 +1,333 @@
+#include "binaryMorphology.hpp"
+
+#include "cpuBackend.hpp"
+
+#include <algorithm>
+#include <bitset>
+
+// --------------------------------------------------------------------------
+BitMask::BitMask()
+    : m_stride(0)
+{
+}
+
+// --------------------------------------------------------------------------
+BitMask::~BitMask()
+{
+}
+
+// --------------------------------------------------------------------------
+void BitMask::create(const sf::Vector2u& size)
+{
+    m_size = size;
+    m_stride = (size.x+63)/64;
+    m_words.assign(m_stride*size.y, 0);
+}
+
+// --------------------------------------------------------------------------
+void BitMask::encode(const sf::Image& image, sf::Uint8 threshold)
+{
+    encode(imageView(image), threshold);
+}
+
+// --------------------------------------------------------------------------
+void BitMask::encode(const std::vector<sf::Uint8>& mask, const sf::Vector2u& size)
+{
+    encode(ImageBuffer<sf::Uint8>(const_cast<sf::Uint8*>(mask.data()), size.x, size.y, 1, size.x), 0);
+}
+
+// --------------------------------------------------------------------------
+void BitMask::encode(const ImageBuffer<sf::Uint8>& buffer, sf::Uint8 threshold)
+{
+    create(buffer.size());
+    const unsigned int ch = buffer.channels();
+
+    parallelFor(0, m_size.y, [&](unsigned int y0, unsigned int y1)
+    {
+        for(unsigned int y=y0;y<y1;++y)
+        {
+            const sf::Uint8* src = buffer.row(y);
+            std::uint64_t* dst = row(y);
+            for(unsigned int x=0;x<m_size.x;++x)
+                if(src[x*ch] > threshold) dst[x/64] |= std::uint64_t(1) << (x%64);
+        }
+    });
+}
+
+// --------------------------------------------------------------------------
+void BitMask::decode(std::vector<sf::Uint8>& mask) const
+{
+    mask.resize(m_size.x*m_size.y);
+    parallelFor(0, m_size.y, [&](unsigned int y0, unsigned int y1)
+    {
+        for(unsigned int y=y0;y<y1;++y)
+            for(unsigned int x=0;x<m_size.x;++x) mask[y*m_size.x+x] = get(x,y) ? 1 : 0;
+    });
+}
+
+// --------------------------------------------------------------------------
+void BitMask::decode(sf::Image& image) const
+{
+    std::vector<sf::Uint8> pixels(m_size.x*m_size.y*4);
+    parallelFor(0, m_size.y, [&](unsigned int y0, unsigned int y1)
+    {
+        for(unsigned int y=y0;y<y1;++y) for(unsigned int x=0;x<m_size.x;++x)
+        {
+            sf::Uint8* p = &pixels[(y*m_size.x+x)*4];
+            sf::Uint8 v = get(x,y) ? 255 : 0;
+            p[0] = v; p[1] = v; p[2] = v; p[3] = 255;
+        }
+    });
+    image.create(m_size.x, m_size.y, pixels.data());
+}
+
+// --------------------------------------------------------------------------
+void BitMask::decode(ImageBuffer<sf::Uint8>& buffer) const
+{
+    buffer.create(m_size.x, m_size.y, 1);
+    parallelFor(0, m_size.y, [&](unsigned int y0, unsigned int y1)
+    {
+        for(unsigned int y=y0;y<y1;++y)
+            for(unsigned int x=0;x<m_size.x;++x) buffer.at(x,y) = get(x,y) ? 255 : 0;
+    });
+}
+
+// --------------------------------------------------------------------------
+void BitMask::set(unsigned int x, unsigned int y, bool value)
+{
+    std::uint64_t bit = std::uint64_t(1) << (x%64);
+    std::uint64_t& w = m_words[y*m_stride + x/64];
+    w = value ? (w | bit) : (w & ~bit);
+}
+
+// --------------------------------------------------------------------------
+unsigned int BitMask::count() const
+{
+    unsigned int n = 0;
+    for(std::uint64_t w : m_words) n += std::bitset<64>(w).count();
+    return n;
+}
+
+// --------------------------------------------------------------------------
+// 64 pixels [pos, pos+64) of a row of n words, pixels outside being `fill`
+static inline std::uint64_t bitsAt(const std::uint64_t* words, int n, int pos, std::uint64_t fill)
+{
+    int q = (pos >= 0) ? pos/64 : -((-pos+63)/64);
+    int r = pos - q*64;
+
+    std::uint64_t lo = (q < 0 || q >= n) ? fill : words[q];
+    if(r == 0) return lo;
+    std::uint64_t hi = (q+1 < 0 || q+1 >= n) ? fill : words[q+1];
+    return (lo >> r) | (hi << (64-r));
+}
+
+// --------------------------------------------------------------------------
+// window of k pixels starting k/2 before each output along a row. The row is extended
+// by the window (outside pixels neutral, equivalent to replicated borders for min/max),
+// then k consecutive pixels are combined by doubling shifts : log2(k) word passes
+template<bool Erosion>
+static void rowPass(const std::uint64_t* src, std::uint64_t* dst, unsigned int width, unsigned int stride, int k,
+                    std::vector<std::uint64_t>& line, std::vector<std::uint64_t>& ext)
+{
+    const std::uint64_t fill = Erosion ? ~std::uint64_t(0) : 0;
+    auto op = [](std::uint64_t a, std::uint64_t b){ return Erosion ? (a & b) : (a | b); };
+
+    // source row with neutral bits past the width
+    line.assign(src, src+stride);
+    if(Erosion && width%64) line[stride-1] |= ~std::uint64_t(0) << (width%64);
+
+    int n = (width+k-1+63)/64;
+    ext.resize(n);
+    for(int i=0;i<n;++i) ext[i] = bitsAt(line.data(), stride, i*64 - k/2, fill);
+
+    // in place : word i only reads words >= i
+    int len = 1;
+    for(;len*2<=k;len*=2)
+        for(int i=0;i<n;++i) ext[i] = op(ext[i], bitsAt(ext.data(), n, i*64+len, fill));
+    if(len < k)
+        for(int i=0;i<n;++i) ext[i] = op(ext[i], bitsAt(ext.data(), n, i*64+k-len, fill));
+
+    std::copy(ext.begin(), ext.begin()+stride, dst);
+    if(width%64) dst[stride-1] &= ~(~std::uint64_t(0) << (width%64));
+}
+
+// --------------------------------------------------------------------------
+// van Herk/Gil-Werman along columns for the rows [y0,y1), all the words of a row at once
+template<bool Erosion>
+static void columnPass(const BitMask& src, BitMask& dst, unsigned int y0, unsigned int y1, int k,
+                       std::vector<std::uint64_t>& buffer)
+{
+    auto op = [](std::uint64_t a, std::uint64_t b){ return Erosion ? (a & b) : (a | b); };
+
+    int lanes = src.stride();
+    int h = src.size().y;
+    int n = y1-y0;
+    int first = int(y0) - k/2;
+    int len = ((n+k-1 + k-1)/k) * k;
+    buffer.resize(2*len*lanes);
+    std::uint64_t* g = buffer.data();
+    std::uint64_t* hb = g + len*lanes;
+
+    for(int b=0;b<len;b+=k)
+    {
+        for(int j=b;j<b+k;++j)
+        {
+            const std::uint64_t* e = src.row(std::min(std::max(first+j, 0), h-1));
+            std::uint64_t* gj = g + j*lanes;
+            if(j == b) for(int l=0;l<lanes;++l) gj[l] = e[l];
+            else for(int l=0;l<lanes;++l) gj[l] = op(gj[l-lanes], e[l]);
+        }
+        for(int j=b+k-1;j>=b;--j)
+        {
+            const std::uint64_t* e = src.row(std::min(std::max(first+j, 0), h-1));
+            std::uint64_t* hj = hb + j*lanes;
+            if(j == b+k-1) for(int l=0;l<lanes;++l) hj[l] = e[l];
+            else for(int l=0;l<lanes;++l) hj[l] = op(hj[l+lanes], e[l]);
+        }
+    }
+
+    for(int y=0;y<n;++y)
+    {
+        const std::uint64_t* hy = hb + y*lanes;
+        const std::uint64_t* gy = g + (y+k-1)*lanes;
+        std::uint64_t* d = dst.row(y0+y);
+        for(int l=0;l<lanes;++l) d[l] = op(hy[l], gy[l]);
+    }
+}
+
+// --------------------------------------------------------------------------
+BinaryMorphology::BinaryMorphology(unsigned int width, unsigned int height, Morphology::MorphType t)
+    : m_width(width)
+    , m_height(height)
+    , m_type(t)
+{
+    initialize();
+}
+
+// --------------------------------------------------------------------------
+BinaryMorphology::~BinaryMorphology()
+{
+    cleanup();
+}
+
+// --------------------------------------------------------------------------
+void BinaryMorphology::initialize()
+{
+}
+
+// --------------------------------------------------------------------------
+void BinaryMorphology::cleanup()
+{
+}
+
+// --------------------------------------------------------------------------
+void BinaryMorphology::setRectangle(unsigned int width, unsigned int height)
+{
+    m_width = width;
+    m_height = height;
+}
+
+// --------------------------------------------------------------------------
+void BinaryMorphology::setType(Morphology::MorphType t)
+{
+    m_type = t;
+}
+
+// --------------------------------------------------------------------------
+void BinaryMorphology::erodeDilate(const BitMask& src, BitMask& dst, bool erosion)
+{
+    sf::Vector2u size = src.size();
+    if(m_rows.size() != size) m_rows.create(size);
+    if(dst.size() != size) dst.create(size);
+
+    int kw = std::max(m_width, 1u), kh = std::max(m_height, 1u);
+
+    parallelFor(0, size.y, [&](unsigned int y0, unsigned int y1)
+    {
+        std::vector<std::uint64_t> line, ext;
+        for(unsigned int y=y0;y<y1;++y)
+        {
+            if(erosion) rowPass<true>(src.row(y), m_rows.row(y), size.x, src.stride(), kw, line, ext);
+            else rowPass<false>(src.row(y), m_rows.row(y), size.x, src.stride(), kw, line, ext);
+        }
+    });
+
+    parallelFor(0, size.y, [&](unsigned int y0, unsigned int y1)
+    {
+        std::vector<std::uint64_t> buffer;
+        if(erosion) columnPass<true>(m_rows, dst, y0, y1, kh, buffer);
+        else columnPass<false>(m_rows, dst, y0, y1, kh, buffer);
+    });
+}
+
+// --------------------------------------------------------------------------
+const BitMask& BinaryMorphology::apply(const BitMask& mask)
+{
+    // src & ~other, or other & ~src
+    auto difference = [](BitMask& dst, const BitMask& a, const BitMask& b)
+    {
+        for(unsigned int y=0;y<dst.size().y;++y)
+            for(unsigned int i=0;i<dst.stride();++i) dst.row(y)[i] = a.row(y)[i] & ~b.row(y)[i];
+    };
+
+    switch(m_type)
+    {
+    case Morphology::Dilation:
+    case Morphology::Erosion:
+        erodeDilate(mask, m_result, m_type==Morphology::Erosion);
+        break;
+
+    case Morphology::Opening:
+    case Morphology::TopHat:
+        erodeDilate(mask, m_pass, true);
+        erodeDilate(m_pass, m_result, false);
+        if(m_type==Morphology::TopHat) difference(m_result, mask, m_result);
+        break;
+
+    case Morphology::Closing:
+    case Morphology::BlackHat:
+        erodeDilate(mask, m_pass, false);
+        erodeDilate(m_pass, m_result, true);
+        if(m_type==Morphology::BlackHat) difference(m_result, m_result, mask);
+        break;
+
+    case Morphology::Gradient:
+        erodeDilate(mask, m_pass, false);
+        erodeDilate(mask, m_result, true);
+        difference(m_result, m_pass, m_result);
+        break;
+    }
+
+    return m_result;
+}
+
+// --------------------------------------------------------------------------
+const sf::Image& BinaryMorphology::apply(const sf::Image& image)
+{
+    m_input.encode(image);
+    apply(m_input);
+    return getResultAsImage();
+}
+
+// --------------------------------------------------------------------------
+const ImageBuffer<sf::Uint8>& BinaryMorphology::apply(const ImageBuffer<sf::Uint8>& buffer)
+{
+    m_input.encode(buffer);
+    apply(m_input);
+    return getResultAsBuffer();
+}
+
+// --------------------------------------------------------------------------
+const sf::Image& BinaryMorphology::getResultAsImage()
+{
+    // decoded here, the result may come from apply(const BitMask&)
+    m_result.decode(m_image);
+    return m_image;
+}
+
+// --------------------------------------------------------------------------
+const ImageBuffer<sf::Uint8>& BinaryMorphology::getResultAsBuffer()
+{
+    m_result.decode(m_buffer);
+    return m_buffer;
+}
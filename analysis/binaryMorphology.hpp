@@ -0,0 +1,96 @@
+#ifndef BINARY_MORPHOLOGY_HPP
+#define BINARY_MORPHOLOGY_HPP
+
+#include <SFML/Graphics.hpp>
+
+#include "imageBuffer.hpp"
+#include "morphology.hpp"
+
+#include <cstdint>
+
+// --------------------------------------------------------------------------
+// Helper class - binary mask packed 64 pixels per word, pixel x of a row in
+// the bit x%64 of its word x/64. Bits past the width are kept to 0.
+class BitMask
+{
+public:
+    BitMask();
+    virtual ~BitMask();
+
+    // empty mask of the given size
+    void create(const sf::Vector2u& size);
+
+    // set pixels : red channel above the threshold
+    void encode(const sf::Image& image, sf::Uint8 threshold = 127);
+    // set pixels : non zero values (row-major)
+    void encode(const std::vector<sf::Uint8>& mask, const sf::Vector2u& size);
+    // set pixels : first channel above the threshold
+    void encode(const ImageBuffer<sf::Uint8>& buffer, sf::Uint8 threshold = 127);
+
+    // 0/1 per pixel, row-major
+    void decode(std::vector<sf::Uint8>& mask) const;
+    // white on black image
+    void decode(sf::Image& image) const;
+    // single channel, 255 for set pixels
+    void decode(ImageBuffer<sf::Uint8>& buffer) const;
+
+    bool get(unsigned int x, unsigned int y) const {return (m_words[y*m_stride + x/64] >> (x%64)) & 1u;}
+    void set(unsigned int x, unsigned int y, bool value);
+
+    // number of set pixels
+    unsigned int count() const;
+
+    const sf::Vector2u& size() const {return m_size;}
+    unsigned int stride() const {return m_stride;}     // words per row
+    std::uint64_t* row(unsigned int y) {return &m_words[y*m_stride];}
+    const std::uint64_t* row(unsigned int y) const {return &m_words[y*m_stride];}
+
+protected:
+    sf::Vector2u m_size;
+    unsigned int m_stride;
+    std::vector<std::uint64_t> m_words;
+};
+
+// --------------------------------------------------------------------------
+// Helper class - morphology with a rectangle on bit masks : word-wide shifts and
+// ORs/ANDs along rows, van Herk/Gil-Werman on words along columns, row bands on
+// the workers. Same results as Morphology (replicated borders) on binary images.
+class BinaryMorphology
+{
+public:
+    BinaryMorphology(unsigned int width = 3, unsigned int height = 3, Morphology::MorphType t = Morphology::Dilation);
+    virtual ~BinaryMorphology();
+
+    void initialize();
+    void cleanup();
+
+    void setRectangle(unsigned int width, unsigned int height);
+    void setType(Morphology::MorphType t);
+
+    const BitMask& apply( const BitMask& mask );
+
+    // binary image (red channel above 127), white on black result
+    const sf::Image& apply( const sf::Image& image );
+
+    // binary buffer (first channel above 127), single channel result (255 for set pixels)
+    const ImageBuffer<sf::Uint8>& apply( const ImageBuffer<sf::Uint8>& buffer );
+
+    const BitMask& getResult() const {return m_result;}
+
+    // last result whatever the apply() used, decoded on each call
+    const sf::Image& getResultAsImage();
+    const ImageBuffer<sf::Uint8>& getResultAsBuffer();
+
+protected:
+    // dilation or erosion of src into dst
+    void erodeDilate( const BitMask& src, BitMask& dst, bool erosion );
+
+    unsigned int m_width, m_height;
+    Morphology::MorphType m_type;
+
+    BitMask m_input, m_pass, m_rows, m_result;
+    sf::Image m_image;
+    ImageBuffer<sf::Uint8> m_buffer;
+};
+
+#endif // BINARY_MORPHOLOGY_HPP
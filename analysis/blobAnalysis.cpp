@@ -1,11 +1,35 @@
 #include "blobAnalysis.hpp"
 
+#include "cpuBackend.hpp"
+
+#include <algorithm>
+#include <climits>
 #include <iostream>
 #include <cmath>
-#include <list>
+
+// --------------------------------------------------------------------------
+// a blob starts on a pixel above the seed threshold and grows over pixels above the grow one
+static const sf::Uint8 s_seedThreshold = 200;
+static const sf::Uint8 s_growThreshold = 50;
+
+// --------------------------------------------------------------------------
+// exact integer sums of the pixels holding a provisional label, so the
+// statistics don't depend on the bands
+struct LabelMoments
+{
+    unsigned int area = 0, perimeter = 0;
+    sf::Vector2i bmin = sf::Vector2i(INT_MAX,INT_MAX), bmax = sf::Vector2i(INT_MIN,INT_MIN);
+    long long sx = 0, sy = 0, sxx = 0, sxy = 0, syy = 0;
+};
 
 // --------------------------------------------------------------------------
 BlobAnalysis::BlobAnalysis()
+    : m_resultValid(false)
+    , m_fromRuns(false)
+    , m_seedsCapacity(0)
+    , m_connectivity(Eight)
+    , m_order(SeedOrder)
+    , m_parallel(false)
 {
     initialize();
 }
@@ -27,94 +51,430 @@ void BlobAnalysis::cleanup()
 }
 
 // --------------------------------------------------------------------------
-bool checkBound(const sf::Vector2i& pos, const sf::Vector2u& size)
+void BlobAnalysis::Statistics::resize(unsigned int count)
 {
-    return pos.x>=0 && pos.x<(int)size.x && pos.y>=0 && pos.y<(int)size.y;
+    area.assign(count, 0);
+    bounds.assign(count, sf::IntRect());
+    centroid.assign(count, sf::Vector2f());
+    m10.assign(count, 0.0); m01.assign(count, 0.0);
+    m20.assign(count, 0.0); m11.assign(count, 0.0); m02.assign(count, 0.0);
+    orientation.assign(count, 0.f);
+    perimeter.assign(count, 0.f);
 }
 
 // --------------------------------------------------------------------------
-const sf::Image& BlobAnalysis::apply( const sf::Image& input)
+void BlobAnalysis::Statistics::computeShape()
+{
+    for(unsigned int k=0;k<size();++k)
+    {
+        double n = area[k];
+        double cx = m10[k]/n, cy = m01[k]/n;
+        double mu20 = m20[k]/n - cx*cx;
+        double mu11 = m11[k]/n - cx*cy;
+        double mu02 = m02[k]/n - cy*cy;
+
+        centroid[k] = sf::Vector2f(cx, cy);
+        orientation[k] = 0.5 * std::atan2(2.0*mu11, mu20-mu02);
+    }
+}
+
+// --------------------------------------------------------------------------
+void BlobAnalysis::setConnectivity(Connectivity connectivity)
+{
+    m_connectivity = connectivity;
+}
+
+// --------------------------------------------------------------------------
+void BlobAnalysis::setParallel(bool enabled)
+{
+    m_parallel = enabled;
+}
+
+// --------------------------------------------------------------------------
+void BlobAnalysis::setLabelOrder(LabelOrder order)
+{
+    m_order = order;
+}
+
+// --------------------------------------------------------------------------
+void BlobAnalysis::label( const ImageBuffer<sf::Uint8>& input, const sf::Vector2i& origin, const sf::Vector2u& frame)
 {
     // reset analysis data
-    sf::Vector2u size = input.getSize();
-    m_image.create(size.x,size.y,sf::Color(0,0,0,0));
+    sf::Vector2u size = input.size();
+    int w = size.x, h = size.y;
+    const unsigned int ch = input.channels();
+    m_size = size;
+    m_origin = origin;
+    m_frame = frame;
+
     m_result.clear();
+    m_resultValid = false;
+    m_fromRuns = false;
+    m_runs.create(sf::Vector2u(0,0));
+    m_labels.assign(w*h, 0);
+    m_sets.reset(w*h+1);
+    if(m_seedsCapacity < (unsigned int)(w*h+1))
+    {
+        m_seeds.reset(new std::atomic<unsigned int>[w*h+1]);
+        m_seedsCapacity = w*h+1;
+    }
 
-    std::list<sf::Vector2i> queue;
-    unsigned int curr_label = 0;
+    // tiles are bands of rows (a single one in serial mode). Provisional labels of
+    // the band starting at y0 are y0*w+1, y0*w+2... : unique, increasing in scan order,
+    // so the root of a component (smallest label) is the label of its first pixel
+    std::vector<unsigned int> bandCount(h, 0);
+    std::vector<char> bandStart(h, 0);
+    std::vector< std::vector<LabelMoments> > bandMoments(h);    // by provisional label of each band
+    auto bands = [&](const std::function<void(unsigned int, unsigned int)>& job)
+    {
+        if(m_parallel) parallelFor(0, h, job); else if(h>0) job(0, h);
+    };
 
-    // search for un-scanned pixel to add in queue
-    for(int x=0;x<(int)size.x;++x) for(int y=0;y<(int)size.y;++y)
+    // first pass, row-major : provisional labels from the already scanned neighbors of the band,
+    // and statistics of each provisional label
+    auto foreground = [&](int x, int y){ return x>=0 && x<w && y>=0 && y<h && input.row(y)[x*ch] > s_growThreshold; };
+    bands([&](unsigned int band0, unsigned int band1)
     {
-        sf::Vector2i position(x,y);
-        unsigned int l = m_image.getPixel(x,y).toInteger();
-        sf::Color value = input.getPixel(x,y);
+        int y0 = band0, y1 = band1;
+        unsigned int next = y0*w+1;
+        std::vector<LabelMoments> moments;
 
-        // if valid pixel with non label
-        if(value.r > 200 && l==0)
+        for(int y=y0;y<y1;++y) for(int x=0;x<w;++x)
         {
-            // set curr label
-            Group n; n.label = ++curr_label;
-
-            // update image, add to queue and record result
-            m_image.setPixel(x,y,sf::Color(n.label));
-            queue.push_back(position);
-            sf::Vector2i rpos(position.x,size.y-position.y);  // inverse Y
-            n.position.push_back(rpos);
-            m_result.push_back(n);
+            int i = y*w+x;
+            if(input.row(y)[x*ch] <= s_growThreshold) continue;
+
+            unsigned int l = 0;
+            auto visit = [&](int nx, int ny)
+            {
+                if(nx<0 || nx>=w || ny<y0) return;
+                unsigned int nl = m_labels[ny*w+nx];
+                if(nl == 0) return;
+                if(l == 0) l = nl;
+                else if(nl != l) l = m_sets.unite(l, nl);
+            };
+
+            visit(x-1,y);
+            visit(x,y-1);
+            if(m_connectivity == Eight) { visit(x-1,y-1); visit(x+1,y-1); }
+
+            if(l == 0)
+            {
+                l = next++;
+                m_sets.makeSet(l);
+                m_seeds[l].store(UINT_MAX, std::memory_order_relaxed);
+                moments.emplace_back();
+            }
+            m_labels[i] = l;
+
+            // statistics in frame coordinates. 4-neighbors above the grow threshold are in the
+            // same component, the others are edges of the blob
+            LabelMoments& m = moments[l - (y0*w+1)];
+            int fx = origin.x+x, fy = origin.y+y;
+            m.area++;
+            m.bmin.x = std::min(m.bmin.x, fx); m.bmin.y = std::min(m.bmin.y, fy);
+            m.bmax.x = std::max(m.bmax.x, fx); m.bmax.y = std::max(m.bmax.y, fy);
+            m.sx += fx; m.sy += fy;
+            m.sxx += (long long)fx*fx; m.sxy += (long long)fx*fy; m.syy += (long long)fy*fy;
+            m.perimeter += !foreground(x-1,y) + !foreground(x+1,y) + !foreground(x,y-1) + !foreground(x,y+1);
         }
 
+        bandStart[y0] = 1;
+        bandCount[y0] = next - (y0*w+1);
+        bandMoments[y0] = std::move(moments);
+    });
 
-        // if pixel wait in queue, check connected
-        while( !queue.empty() )
+    // seams : merge the first row of each band with the last row of the previous one (lock-free)
+    std::vector<unsigned int> seams;
+    for(int y=1;y<h;++y) if(bandStart[y]) seams.push_back(y);
+    parallelFor(0, seams.size(), [&](unsigned int s0, unsigned int s1)
+    {
+        for(unsigned int s=s0;s<s1;++s)
         {
-            // unqueue
-            sf::Vector2i qpos = queue.front();
-            queue.pop_front();
-
-            // scan neighbors pixels
-            for(int oftx=-1;oftx<=1;++oftx) for(int ofty=-1;ofty<=1;++ofty)
+            int y = seams[s];
+            for(int x=0;x<w;++x)
             {
-                sf::Vector2i position2 = qpos + sf::Vector2i(oftx,ofty);
+                unsigned int l = m_labels[y*w+x];
+                if(l == 0) continue;
 
-                if( checkBound(position2, size) )
+                for(int ox=-1;ox<=1;++ox)
                 {
-                    sf::Color value2 = input.getPixel(position2.x,position2.y);
-                    unsigned int l2 = m_image.getPixel(position2.x,position2.y).toInteger();
-
-                    // if valid pixel with non label
-                    if(value2.r > 50 && l2==0)
-                    {
-                        // set curr label
-                        l2 = curr_label;
-
-                        // update image, add to queue and record result
-                        m_image.setPixel(position2.x,position2.y,sf::Color(l2));
-                        queue.push_back(position2);
-
-                        sf::Vector2i rpos(position2.x,size.y-position2.y);  // inverse Y
-                        m_result.back().position.push_back(rpos);
-                    }
+                    if(ox!=0 && m_connectivity!=Eight) continue;
+                    int nx = x+ox;
+                    if(nx<0 || nx>=w) continue;
+
+                    unsigned int nl = m_labels[(y-1)*w+nx];
+                    if(nl != 0) m_sets.unite(l, nl);
                 }
+            }
+        }
+    });
 
-            }// scan neighbors pixels
+    // second pass : resolve equivalences, keep the first seed of each component
+    // (column-major key, like the former flood fill)
+    bands([&](unsigned int y0, unsigned int y1)
+    {
+        for(int y=y0;y<(int)y1;++y) for(int x=0;x<w;++x)
+        {
+            int i = y*w+x;
+            if(m_labels[i] == 0) continue;
+
+            unsigned int r = m_sets.find(m_labels[i]);
+            m_labels[i] = r;
+            if(input.row(y)[x*ch] <= s_seedThreshold) continue;
+
+            unsigned int key = x*h+y;
+            unsigned int curr = m_seeds[r].load(std::memory_order_relaxed);
+            while(key < curr && !m_seeds[r].compare_exchange_weak(curr, key, std::memory_order_relaxed)) {}
         }
+    });
 
+    // components without any seed pixel are dropped, the others are numbered by label order
+    std::vector<unsigned int> roots;
+    for(int y=0;y<h;++y)
+    {
+        if(!bandStart[y]) continue;
+        unsigned int first = y*w+1;
+        for(unsigned int l=first;l<first+bandCount[y];++l)
+            if(m_sets.find(l)==l && m_seeds[l].load(std::memory_order_relaxed)!=UINT_MAX) roots.push_back(l);
     }
+    if(m_order == SeedOrder)
+        std::sort(roots.begin(), roots.end(), [&](unsigned int a, unsigned int b){return m_seeds[a].load(std::memory_order_relaxed) < m_seeds[b].load(std::memory_order_relaxed);});
+
+    for(unsigned int k=0;k<roots.size();++k)
+        m_seeds[roots[k]].store(k+1, std::memory_order_relaxed);
 
-    // visualization pass
-    for(int x=0;x<(int)size.x;++x) for(int y=0;y<(int)size.y;++y)
+    // final labels
+    unsigned int curr_label = roots.size();
+    bands([&](unsigned int y0, unsigned int y1)
     {
-        float l = float(m_image.getPixel(x,y).toInteger());
-        l /= float(curr_label);
-        l *= 16777215; // 255.0;
-        m_image.setPixel(x,y,sf::Color(int(l)));
+        for(int i=y0*w;i<(int)y1*w;++i)
+        {
+            unsigned int r = m_labels[i];
+            if(r == 0) continue;
+
+            // dropped roots still hold UINT_MAX
+            unsigned int l = m_seeds[r].load(std::memory_order_relaxed);
+            m_labels[i] = (l == UINT_MAX) ? 0 : l;
+        }
+    });
+
+    // statistics : provisional labels folded into their component
+    m_stats.resize(curr_label);
+    for(int y=0;y<h;++y)
+    {
+        if(!bandStart[y]) continue;
+        unsigned int first = y*w+1;
+        for(unsigned int l=first;l<first+bandCount[y];++l)
+        {
+            unsigned int r = m_seeds[m_sets.find(l)].load(std::memory_order_relaxed);
+            if(r == UINT_MAX) continue;
+
+            const LabelMoments& m = bandMoments[y][l-first];
+            unsigned int k = r-1;
+            sf::IntRect& b = m_stats.bounds[k];
+            sf::Vector2i bmin = m.bmin, bmax = m.bmax;
+            if(m_stats.area[k] > 0)
+            {
+                bmin.x = std::min(bmin.x, b.left); bmin.y = std::min(bmin.y, b.top);
+                bmax.x = std::max(bmax.x, b.left+b.width-1); bmax.y = std::max(bmax.y, b.top+b.height-1);
+            }
+            b = sf::IntRect(bmin.x, bmin.y, bmax.x-bmin.x+1, bmax.y-bmin.y+1);
+
+            m_stats.area[k] += m.area;
+            m_stats.perimeter[k] += m.perimeter;
+            m_stats.m10[k] += m.sx; m_stats.m01[k] += m.sy;
+            m_stats.m20[k] += m.sxx; m_stats.m11[k] += m.sxy; m_stats.m02[k] += m.syy;
+        }
     }
 
+    m_stats.computeShape();
+}
+
+// --------------------------------------------------------------------------
+const sf::Image& BlobAnalysis::apply( const sf::Image& input)
+{
+    return apply(input, sf::IntRect(0, 0, input.getSize().x, input.getSize().y));
+}
+
+// --------------------------------------------------------------------------
+const sf::Image& BlobAnalysis::apply( const sf::Image& input, const sf::IntRect& roi)
+{
+    sf::IntRect region = roi;
+    sf::IntRect window = apronWindow(region, 0, input.getSize());
+    label(imageView(input).view(window), sf::Vector2i(window.left, window.top), input.getSize());
+
+    // visualization
+    sf::Vector2u size = m_size;
+    unsigned int curr_label = m_stats.size();
+    std::vector<sf::Uint8> pixels(size.x*size.y*4, 0);
+    parallelFor(0, size.y, [&](unsigned int y0, unsigned int y1)
+    {
+        for(unsigned int i=y0*size.x;i<y1*size.x;++i)
+        {
+            unsigned int l = m_labels[i];
+            if(l == 0) continue;
+
+            float v = float(l);
+            v /= float(curr_label);
+            v *= 16777215; // 255.0;
+            sf::Color c = sf::Color(int(v));
+            pixels[i*4] = c.r; pixels[i*4+1] = c.g; pixels[i*4+2] = c.b; pixels[i*4+3] = c.a;
+        }
+    });
+
+    m_image.create(size.x, size.y, pixels.data());
 
     return m_image;
 }
 
+// --------------------------------------------------------------------------
+const ImageBuffer<unsigned int>& BlobAnalysis::apply( const ImageBuffer<sf::Uint8>& input)
+{
+    return apply(input, sf::IntRect(0, 0, input.width(), input.height()));
+}
+
+// --------------------------------------------------------------------------
+const ImageBuffer<unsigned int>& BlobAnalysis::apply( const ImageBuffer<sf::Uint8>& input, const sf::IntRect& roi)
+{
+    sf::IntRect region = roi;
+    sf::IntRect window = apronWindow(region, 0, input.size());
+    label(input.view(window), sf::Vector2i(window.left, window.top), input.size());
+
+    m_image = sf::Image();
+    m_labelBuffer = ImageBuffer<unsigned int>(m_labels.data(), m_size.x, m_size.y, 1, m_size.x);
+    return m_labelBuffer;
+}
+
+// --------------------------------------------------------------------------
+const RunLengthMask& BlobAnalysis::apply( const RunLengthMask& mask)
+{
+    sf::Vector2u size = mask.size();
+    int h = size.y;
+    int d = (m_connectivity == Eight) ? 1 : 0;   // runs of adjacent rows touch when overlapping by 1-d pixels
+
+    m_result.clear();
+    m_resultValid = false;
+    m_fromRuns = true;
+    m_labels.clear();
+    m_image = sf::Image();
+    m_runs = mask;
+    m_size = size;
+    m_origin = sf::Vector2i(0,0);
+    m_frame = size;
+
+    unsigned int n = m_runs.runCount();
+    m_sets.reset(n+1);
+    for(unsigned int i=1;i<=n;++i) m_sets.makeSet(i);
+
+    // overlapping runs of consecutive rows : same component, and shared pixel sides for the perimeter
+    std::vector<unsigned int> covered(n, 0);
+    for(int y=1;y<h;++y)
+    {
+        unsigned int i = m_runs.rowBegin(y-1), iend = m_runs.rowEnd(y-1);
+        unsigned int j = m_runs.rowBegin(y), jend = m_runs.rowEnd(y);
+        while(i<iend && j<jend)
+        {
+            const RunLengthMask::Run& a = m_runs.runs()[i];
+            const RunLengthMask::Run& b = m_runs.runs()[j];
+            if(a.x < b.end+d && b.x < a.end+d) m_sets.unite(i+1, j+1);
+
+            int shared = std::min(a.end, b.end) - std::max(a.x, b.x);
+            if(shared > 0) { covered[i] += shared; covered[j] += shared; }
+
+            if(a.end < b.end) ++i; else ++j;
+        }
+    }
+
+    // roots are the first run of each component (scan order), seed key like the pixel path
+    std::vector<unsigned int> roots;
+    std::vector<unsigned int> keys(n+1, UINT_MAX);
+    for(int y=0;y<h;++y) for(unsigned int i=m_runs.rowBegin(y);i<m_runs.rowEnd(y);++i)
+    {
+        unsigned int r = m_sets.find(i+1);
+        if(r == i+1) roots.push_back(r);
+        keys[r] = std::min(keys[r], (unsigned int)(m_runs.runs()[i].x*h+y));
+    }
+    if(m_order == SeedOrder)
+        std::sort(roots.begin(), roots.end(), [&](unsigned int a, unsigned int b){return keys[a] < keys[b];});
+
+    std::vector<unsigned int> labels(n+1, 0);
+    for(unsigned int k=0;k<roots.size();++k) labels[roots[k]] = k+1;
+
+    // labels and statistics, closed form sums over each run
+    m_stats.resize(roots.size());
+    std::vector<sf::Vector2i> bmax(roots.size(), sf::Vector2i(-1,-1));
+    for(int y=0;y<h;++y) for(unsigned int i=m_runs.rowBegin(y);i<m_runs.rowEnd(y);++i)
+    {
+        RunLengthMask::Run& run = m_runs.run(i);
+        unsigned int l = labels[m_sets.find(i+1)];
+        run.label = l;
+
+        unsigned int k = l-1;
+        long long a = run.x, b = run.end-1, len = run.end-run.x;
+        long long sx = (a+b)*len/2;
+        long long sxx = b*(b+1)*(2*b+1)/6 - (a-1)*a*(2*a-1)/6;
+
+        sf::IntRect& r = m_stats.bounds[k];
+        if(m_stats.area[k] == 0) r = sf::IntRect(run.x, y, 0, 0);
+        r.left = std::min(r.left, run.x); r.top = std::min(r.top, y);
+        bmax[k].x = std::max(bmax[k].x, run.end-1); bmax[k].y = std::max(bmax[k].y, y);
+
+        m_stats.area[k] += len;
+        m_stats.m10[k] += sx; m_stats.m01[k] += (double)y*len;
+        m_stats.m20[k] += sxx; m_stats.m11[k] += (double)y*sx; m_stats.m02[k] += (double)y*y*len;
+        m_stats.perimeter[k] += 2 + 2*len - covered[i];
+    }
+
+    for(unsigned int k=0;k<roots.size();++k)
+    {
+        sf::IntRect& r = m_stats.bounds[k];
+        r.width = bmax[k].x-r.left+1; r.height = bmax[k].y-r.top+1;
+    }
+    m_stats.computeShape();
+
+    return m_runs;
+}
+
+// --------------------------------------------------------------------------
+const std::vector<BlobAnalysis::Group>& BlobAnalysis::getResult()
+{
+    if(m_resultValid) return m_result;
+
+    // groups, row-major
+    sf::Vector2u size = m_size;
+    m_result.assign(m_stats.size(), Group());
+    for(unsigned int k=0;k<m_result.size();++k)
+    {
+        m_result[k].label = k+1;
+        m_result[k].position.reserve(m_stats.area[k]);
+    }
+
+    if(m_fromRuns)
+    {
+        for(unsigned int y=0;y<size.y;++y) for(unsigned int i=m_runs.rowBegin(y);i<m_runs.rowEnd(y);++i)
+        {
+            const RunLengthMask::Run& r = m_runs.runs()[i];
+            for(int x=r.x;x<r.end;++x) m_result[r.label-1].position.push_back(sf::Vector2i(x,size.y-y));
+        }
+
+        m_resultValid = true;
+        return m_result;
+    }
+
+    for(unsigned int y=0;y<size.y;++y) for(unsigned int x=0;x<size.x;++x)
+    {
+        unsigned int l = m_labels[y*size.x+x];
+        if(l == 0) continue;
+
+        sf::Vector2i rpos(m_origin.x+x, m_frame.y-(m_origin.y+y));  // frame coordinates, inverse Y
+        m_result[l-1].position.push_back(rpos);
+    }
+
+    m_resultValid = true;
+    return m_result;
+}
+
 // --------------------------------------------------------------------------
 const sf::Image& BlobAnalysis::getResultAsImage()
 {
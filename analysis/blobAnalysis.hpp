@@ -3,35 +3,117 @@
 
 #include <SFML/Graphics.hpp>
 
+#include "imageBuffer.hpp"
+#include "runLengthMask.hpp"
+#include "unionFind.hpp"
+
 // --------------------------------------------------------------------------
 // Helper class - give functions for connected-component analysis on image
 class BlobAnalysis
 {
 public:
 
+    enum Connectivity
+    {
+        Four = 4,
+        Eight = 8
+    };
+
+    enum LabelOrder
+    {
+        SeedOrder,      // by first seed pixel in column-major order (former flood fill)
+        ScanOrder       // by first pixel in row-major order
+    };
+
     struct Group
     {
         std::vector<sf::Vector2i> position;
         unsigned int label;
     };
 
+    // per label statistics, index = label-1, image coordinates (y downward)
+    struct Statistics
+    {
+        std::vector<unsigned int> area;             // pixel count
+        std::vector<sf::IntRect> bounds;            // bounding box
+        std::vector<sf::Vector2f> centroid;
+        std::vector<double> m10, m01;               // first order moments
+        std::vector<double> m20, m11, m02;          // second order moments
+        std::vector<float> orientation;             // major axis angle (radians, from x axis)
+        std::vector<float> perimeter;               // crack length : pixel sides facing the outside
+
+        void resize(unsigned int count);
+        void computeShape();            // centroid and orientation from the moments
+        unsigned int size() const {return area.size();}
+    };
+
     BlobAnalysis();
     virtual ~BlobAnalysis();
 
     void initialize();
     void cleanup();
 
+    // neighborhood of the components (8-connectivity by default)
+    void setConnectivity(Connectivity connectivity);
+
+    // label tiles of rows on worker threads, then merge them along the seams.
+    // Same components as the serial path, numbered by the label order in both cases
+    void setParallel(bool enabled);
+    void setLabelOrder(LabelOrder order);
+
     // compute a connectivity check from a input
     const sf::Image& apply( const sf::Image& image);
 
+    // same on the first channel of a buffer, without visualization : the result is
+    // the label buffer (0 = background), valid until the next apply
+    const ImageBuffer<unsigned int>& apply( const ImageBuffer<sf::Uint8>& input);
+
+    // labeling of a region of interest only (clipped to the image), blobs being cut at its
+    // border. Results have the region size, statistics and groups are in image coordinates
+    const sf::Image& apply( const sf::Image& image, const sf::IntRect& roi);
+    const ImageBuffer<unsigned int>& apply( const ImageBuffer<sf::Uint8>& input, const sf::IntRect& roi);
+
+    // run-based labeling of a binary mask, every set pixel being a seed. Labels are
+    // stored in the runs of the result : no label buffer nor image is produced
+    const RunLengthMask& apply( const RunLengthMask& mask);
+
     // get result image
     const sf::Image& getResultAsImage();
 
-    const std::vector<Group>& getResult() {return m_result;}
+    // labeled runs of the last mask
+    const RunLengthMask& getRuns() const {return m_runs;}
+
+    // per pixel positions of each blob, only built on the first call after apply
+    const std::vector<Group>& getResult();
+
+    // statistics computed during the labeling
+    const Statistics& getStatistics() const {return m_stats;}
+
+    // label of each pixel of the last image or region (0 = background), row-major. Empty after a mask labeling
+    const std::vector<unsigned int>& getLabels() const {return m_labels;}
 
 protected:
+    // labels and statistics of the first channel of a buffer, its pixel (0,0)
+    // being at origin in a frame (full image) of the given size
+    void label( const ImageBuffer<sf::Uint8>& input, const sf::Vector2i& origin, const sf::Vector2u& frame);
+
     sf::Image m_image;                  // target renderTexture
+    sf::Vector2u m_size;                // size of the last labeled image or region
+    sf::Vector2i m_origin;              // position of the region in the frame
+    sf::Vector2u m_frame;               // size of the full image
     std::vector<Group> m_result;        // analysis result;
+    bool m_resultValid;
+    Statistics m_stats;
+    std::vector<unsigned int> m_labels; // label buffer
+    ImageBuffer<unsigned int> m_labelBuffer;    // view of m_labels
+    RunLengthMask m_runs;               // labeled runs (mask path)
+    bool m_fromRuns;                    // last apply was a mask one
+    UnionFind m_sets;                   // provisional labels equivalences
+    std::unique_ptr<std::atomic<unsigned int>[]> m_seeds;  // first seed key, then final label of each root
+    unsigned int m_seedsCapacity;
+    Connectivity m_connectivity;
+    LabelOrder m_order;
+    bool m_parallel;
 };
 
 #endif // BLOB_ANALYSIS_HPP
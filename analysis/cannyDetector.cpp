@@ -0,0 +1,229 @@
+#include "cannyDetector.hpp"
+
+#include "cpuBackend.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// --------------------------------------------------------------------------
+// Gaussian5x5Filter coefficients
+static const float s_gaussian[5][5] =
+{
+    {2.0f,  4.0f,  5.0f,  4.0f, 2.0f},
+    {4.0f,  9.0f, 12.0f,  9.0f, 4.0f},
+    {5.0f, 12.0f, 15.0f, 12.0f, 5.0f},
+    {4.0f,  9.0f, 12.0f,  9.0f, 4.0f},
+    {2.0f,  4.0f,  5.0f,  4.0f, 2.0f}
+};
+
+// --------------------------------------------------------------------------
+// source pixels a region needs on each side : blur (2), gradients (1), local maxima (1)
+static const unsigned int s_apron = 4;
+
+// --------------------------------------------------------------------------
+// stages are rounded to 8-bit levels like the render targets of the shader chain
+static float quantize(float v)
+{
+    return std::floor(std::min(std::max(v, 0.0f), 1.0f) * 255.0f + 0.5f) / 255.0f;
+}
+
+// --------------------------------------------------------------------------
+CannyDetector::CannyDetector()
+    : m_intermediates(None)
+{
+    initialize();
+}
+
+// --------------------------------------------------------------------------
+CannyDetector::~CannyDetector()
+{
+    cleanup();
+}
+
+// --------------------------------------------------------------------------
+void CannyDetector::initialize()
+{
+}
+
+// --------------------------------------------------------------------------
+void CannyDetector::cleanup()
+{
+}
+
+// --------------------------------------------------------------------------
+void CannyDetector::setIntermediates(unsigned int flags)
+{
+    m_intermediates = flags;
+}
+
+// --------------------------------------------------------------------------
+void CannyDetector::detect(const ImageBuffer<sf::Uint8>& image, float thresholdMajor, float thresholdMinor)
+{
+    sf::Vector2u size = image.size();
+    int w = size.x, h = size.y;
+    const unsigned int ch = image.channels();
+
+    m_mask.assign(w*h, 0);
+    m_blurred.clear(); m_gradients.clear(); m_maxima.clear();
+    if(m_intermediates & Blurred) m_blurred.resize(w*h);
+    if(m_intermediates & Gradients) m_gradients.resize(w*h);
+    if(m_intermediates & Maxima) m_maxima.resize(w*h);
+
+    if(w==0 || h==0) return;
+
+    const float pi = 3.141592f;
+    auto clampX = [w](int x){ return std::min(std::max(x,0), w-1); };
+    auto clampY = [h](int y){ return std::min(std::max(y,0), h-1); };
+
+    parallelFor(0, h, [&](unsigned int band0, unsigned int band1)
+    {
+        int y0 = band0, y1 = band1;
+
+        // ring buffers : 5 input rows (padded by 2), 3 blurred rows, 3 gradient rows
+        int pw = w + 4;
+        std::vector<float> input(5*pw), blurred(3*w), magnitude(3*w), gradX(3*w), gradY(3*w);
+
+        auto slot = [](int r, int n){ return ((r % n) + n) % n; };
+
+        auto loadInput = [&](int r)
+        {
+            float* row = &input[slot(r,5)*pw];
+            const sf::Uint8* src = image.row(clampY(r));
+            for(int x=-2;x<w+2;++x) row[x+2] = src[clampX(x)*ch] / 255.0f;
+        };
+
+        // blurred row r from input rows r-2..r+2
+        auto blurRow = [&](int r)
+        {
+            float* dst = &blurred[slot(r,3)*w];
+            const float* rows[5];
+            for(int j=0;j<5;++j) rows[j] = &input[slot(r+j-2,5)*pw];
+
+            for(int x=0;x<w;++x)
+            {
+                float acc = 0.0f;
+                for(int j=0;j<5;++j) for(int i=0;i<5;++i) acc += rows[j][x+i] * s_gaussian[i][j];
+                dst[x] = quantize(acc / 159.0f);
+            }
+            if(!m_blurred.empty() && r>=y0 && r<y1) std::copy(dst, dst+w, &m_blurred[r*w]);
+        };
+
+        // gradient row g from blurred rows g-1..g+1 (central differences, like GradientsMap)
+        // outside the image the edge blurred row is replicated, as the texture lookups clamp
+        auto gradientRow = [&](int g)
+        {
+            const float* up = &blurred[slot(clampY(g-1),3)*w];
+            const float* mid = &blurred[slot(g,3)*w];
+            const float* down = &blurred[slot(clampY(g+1),3)*w];
+            float* mag = &magnitude[slot(g,3)*w];
+            float* gx = &gradX[slot(g,3)*w];
+            float* gy = &gradY[slot(g,3)*w];
+
+            for(int x=0;x<w;++x)
+            {
+                gx[x] = mid[clampX(x+1)] - mid[clampX(x-1)];
+                gy[x] = down[x] - up[x];
+                mag[x] = quantize(std::sqrt(gx[x]*gx[x] + gy[x]*gy[x]));
+            }
+            if(!m_gradients.empty() && g>=y0 && g<y1) std::copy(mag, mag+w, &m_gradients[g*w]);
+        };
+
+        // local maxima along the gradient direction and classification of row y
+        auto maximaRow = [&](int y)
+        {
+            const float* mag = &magnitude[slot(y,3)*w];
+            const float* gx = &gradX[slot(y,3)*w];
+            const float* gy = &gradY[slot(y,3)*w];
+            sf::Uint8* cls = &m_mask[y*w];
+
+            auto sample = [&](int x, float ox, float oy)
+            {
+                int sx = clampX(x + int(std::floor(0.5f + ox)));
+                int sy = y + int(std::floor(0.5f + oy));
+                if(sy<0 || sy>=h) sy = y;   // rows outside replicate the edge one
+                return magnitude[slot(sy,3)*w + sx];
+            };
+
+            for(int x=0;x<w;++x)
+            {
+                float v = mag[x];
+                cls[x] = 0;
+
+                // below the minor threshold the pixel can't be an edge whatever its neighbors
+                if(v <= thresholdMinor && m_maxima.empty()) continue;
+
+                // orientation stored on 8 bits like the gradients map
+                float ori = 0.0f;
+                if(gx[x]==0.0f)
+                    ori = gy[x]>0.0f ? pi*0.5f : -pi*0.5f;
+                else
+                    ori = std::atan2(gy[x],gx[x]);
+                ori = quantize((ori + pi) / (2.0f*pi)) * (2.0f*pi) - pi;
+                float dx = std::cos(ori), dy = std::sin(ori);
+
+                if(sample(x, -dx, -dy) > v) v = 0.0f;
+                if(sample(x, dx, dy) > v) v = 0.0f;
+
+                if(v > thresholdMinor) cls[x] = (v > thresholdMajor) ? 2 : 1;
+                if(!m_maxima.empty()) m_maxima[y*w+x] = v;
+            }
+        };
+
+        // prime the rings with the apron rows, then stream
+        for(int r=y0-4;r<y0;++r) loadInput(r);
+        for(int r=y0-2;r<y1+2;++r)
+        {
+            loadInput(r+2);
+            if(r >= 0 && r < h) blurRow(r);
+            if(r >= y0 && r-1 >= 0 && r-1 < h) gradientRow(r-1);
+            if(r >= y0+2) maximaRow(r-2);
+        }
+    });
+
+    m_hysteresis.apply(m_mask, size);
+}
+
+// --------------------------------------------------------------------------
+const ImageBuffer<sf::Uint8>& CannyDetector::apply(const ImageBuffer<sf::Uint8>& image, float thresholdMajor, float thresholdMinor)
+{
+    return apply(image, sf::IntRect(0, 0, image.width(), image.height()), thresholdMajor, thresholdMinor);
+}
+
+// --------------------------------------------------------------------------
+const ImageBuffer<sf::Uint8>& CannyDetector::apply(const ImageBuffer<sf::Uint8>& image, const sf::IntRect& roi, float thresholdMajor, float thresholdMinor)
+{
+    sf::IntRect region = roi;
+    sf::IntRect window = apronWindow(region, s_apron, image.size());
+    detect(image.view(window), thresholdMajor, thresholdMinor);
+
+    m_buffer.create(region.width, region.height, 1);
+    for(int y=0;y<region.height;++y)
+    {
+        const sf::Uint8* edges = &m_mask[(region.top+y)*window.width + region.left];
+        sf::Uint8* dst = m_buffer.row(y);
+        for(int x=0;x<region.width;++x) dst[x] = edges[x] ? 255 : 0;
+    }
+
+    return m_buffer;
+}
+
+// --------------------------------------------------------------------------
+const sf::Image& CannyDetector::apply(const sf::Image& image, float thresholdMajor, float thresholdMinor)
+{
+    // visualization
+    bufferToImage(apply(imageView(image), thresholdMajor, thresholdMinor), m_image);
+    return m_image;
+}
+
+// --------------------------------------------------------------------------
+const sf::Image& CannyDetector::apply(const sf::Image& image, const sf::IntRect& roi, float thresholdMajor, float thresholdMinor)
+{
+    bufferToImage(apply(imageView(image), roi, thresholdMajor, thresholdMinor), m_image);
+    return m_image;
+}
+
+// --------------------------------------------------------------------------
+const sf::Image& CannyDetector::getResultAsImage()
+{
+    return m_image;
+}
@@ -0,0 +1,70 @@
+#ifndef CANNY_DETECTOR_HPP
+#define CANNY_DETECTOR_HPP
+
+#include <SFML/Graphics.hpp>
+
+#include "hysteresis.hpp"
+#include "imageBuffer.hpp"
+
+// --------------------------------------------------------------------------
+// Helper class - Canny edge detection on CPU as one streaming pass
+// (5x5 gaussian, gradients map, local maxima, double threshold) followed by hysteresis.
+// Each worker handles a band of rows and only keeps a few rows per stage alive.
+class CannyDetector
+{
+public:
+
+    // intermediate results that can be kept (full frame)
+    enum Intermediate
+    {
+        None      = 0,
+        Blurred   = 1,
+        Gradients = 2,
+        Maxima    = 4
+    };
+
+    CannyDetector();
+    virtual ~CannyDetector();
+
+    void initialize();
+    void cleanup();
+
+    // combination of Intermediate flags
+    void setIntermediates(unsigned int flags);
+
+    // compute edges of the red channel of an input, thresholds like DoubleThreshold
+    const sf::Image& apply( const sf::Image& image, float thresholdMajor = 0.04, float thresholdMinor = 0.03 );
+
+    // same on the first channel of a buffer, single channel result (255 for edges)
+    const ImageBuffer<sf::Uint8>& apply( const ImageBuffer<sf::Uint8>& image, float thresholdMajor = 0.04, float thresholdMinor = 0.03 );
+
+    // same on a region of interest, result of the region size (clipped to the image). The apron
+    // needed by the blur and the gradients is read around it, edges are tracked within that window.
+    // The mask and the intermediates cover the region and its apron
+    const sf::Image& apply( const sf::Image& image, const sf::IntRect& roi, float thresholdMajor = 0.04, float thresholdMinor = 0.03 );
+    const ImageBuffer<sf::Uint8>& apply( const ImageBuffer<sf::Uint8>& image, const sf::IntRect& roi, float thresholdMajor = 0.04, float thresholdMinor = 0.03 );
+
+    // get result image (white edges)
+    const sf::Image& getResultAsImage();
+
+    // edge mask, 1 for edge pixels (row-major)
+    const std::vector<sf::Uint8>& getMask() const {return m_mask;}
+
+    // intermediate results, row-major, empty unless requested
+    const std::vector<float>& getBlurred() const {return m_blurred;}
+    const std::vector<float>& getGradients() const {return m_gradients;}      // magnitude
+    const std::vector<float>& getMaxima() const {return m_maxima;}
+
+protected:
+    // edge mask and intermediates of the first channel of a buffer
+    void detect( const ImageBuffer<sf::Uint8>& image, float thresholdMajor, float thresholdMinor );
+
+    sf::Image m_image;                  // result image
+    ImageBuffer<sf::Uint8> m_buffer;    // result buffer
+    std::vector<sf::Uint8> m_mask;      // 0 none, 1 weak, 2 strong then edge mask
+    Hysteresis m_hysteresis;            // edge tracking
+    unsigned int m_intermediates;
+    std::vector<float> m_blurred, m_gradients, m_maxima;
+};
+
+#endif // CANNY_DETECTOR_HPP
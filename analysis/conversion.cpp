@@ -1,7 +1,15 @@
 #include "conversion.hpp"
 
+#include "cpuBackend.hpp"
+
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 
+#if defined(ANALYSIS_SIMD_SSE)
+    #include <emmintrin.h>
+#endif
+
 // --------------------------------------------------------------------------
 #define GLSL_CODE( src ) #src
 
@@ -191,3 +199,438 @@ const sf::Texture& TextureConversion::getResultAsTexture()
 {
     return m_target.getTexture();
 }
+
+// --------------------------------------------------------------------------
+// sRGB transfer of the grayscale shader as tables : 8 bits levels to linear values,
+// and linear values sampled on 4096 steps to rounded 8 bits levels (the sampling
+// moves the result by less than half a level, so the output stays within 1 level)
+struct SRGBTables
+{
+    static const unsigned int steps = 4096;
+
+    float linear[256];
+    sf::Uint8 encoded[steps];
+
+    SRGBTables()
+    {
+        for(unsigned int i=0;i<256;++i)
+        {
+            double c = i / 255.0;
+            linear[i] = float(c > 0.04045 ? std::pow((c+0.055)/1.055, 2.4) : c/12.92);
+        }
+        for(unsigned int i=0;i<steps;++i)
+        {
+            double l = double(i) / (steps-1);
+            double c = l > 0.0031308 ? std::pow(l, 1.0/2.4) * 1.055 - 0.055 : l * 12.92;
+            encoded[i] = (sf::Uint8)std::lround(std::min(std::max(c, 0.0), 1.0) * 255.0);
+        }
+    }
+};
+
+// --------------------------------------------------------------------------
+static const SRGBTables& srgbTables()
+{
+    static const SRGBTables tables;
+    return tables;
+}
+
+// --------------------------------------------------------------------------
+ImageConversion::ImageConversion()
+{
+    initialize();
+}
+
+// --------------------------------------------------------------------------
+ImageConversion::~ImageConversion()
+{
+    cleanup();
+}
+
+// --------------------------------------------------------------------------
+void ImageConversion::initialize()
+{
+}
+
+// --------------------------------------------------------------------------
+void ImageConversion::cleanup()
+{
+}
+
+// --------------------------------------------------------------------------
+void ImageConversion::grayscale(const sf::Uint8* rgba, sf::Uint8* gray, unsigned int count, GrayscaleMode mode)
+{
+    const SRGBTables& tables = srgbTables();
+    const float wr = 0.2126f, wg = 0.7152f, wb = 0.0722f;
+    const int last = SRGBTables::steps-1;
+    unsigned int i = 0;
+
+    if(mode == Luminance)
+    {
+#if defined(ANALYSIS_SIMD_SSE)
+        // 4 pixels per register, the tables lookups stay scalar
+        const __m128 vwr = _mm_set1_ps(wr), vwg = _mm_set1_ps(wg), vwb = _mm_set1_ps(wb);
+        const __m128 scale = _mm_set1_ps(float(last)), half = _mm_set1_ps(0.5f);
+        alignas(16) int index[4];
+        for(;i+4<=count;i+=4)
+        {
+            const sf::Uint8* p = rgba + i*4;
+            __m128 r = _mm_set_ps(tables.linear[p[12]], tables.linear[p[8]], tables.linear[p[4]], tables.linear[p[0]]);
+            __m128 g = _mm_set_ps(tables.linear[p[13]], tables.linear[p[9]], tables.linear[p[5]], tables.linear[p[1]]);
+            __m128 b = _mm_set_ps(tables.linear[p[14]], tables.linear[p[10]], tables.linear[p[6]], tables.linear[p[2]]);
+            __m128 l = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, vwr), _mm_mul_ps(g, vwg)), _mm_mul_ps(b, vwb));
+            _mm_store_si128((__m128i*)index, _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(l, scale), half)));
+            for(int k=0;k<4;++k) gray[i+k] = tables.encoded[std::min(index[k], last)];
+        }
+#endif
+        for(;i<count;++i)
+        {
+            const sf::Uint8* p = rgba + i*4;
+            float l = wr*tables.linear[p[0]] + wg*tables.linear[p[1]] + wb*tables.linear[p[2]];
+            gray[i] = tables.encoded[std::min(int(l*last + 0.5f), last)];
+        }
+        return;
+    }
+
+    // length of the color in levels : sqrt(r^2+g^2+b^2), saturated
+    const float factor = (mode == QuadraticMean) ? 1.0f/3.0f : 1.0f;
+
+#if defined(ANALYSIS_SIMD_SSE)
+    const __m128i byte = _mm_set1_epi32(0xff);
+    const __m128 vfactor = _mm_set1_ps(factor), white = _mm_set1_ps(255.0f), half = _mm_set1_ps(0.5f);
+    alignas(16) int level[4];
+    for(;i+4<=count;i+=4)
+    {
+        __m128i px = _mm_loadu_si128((const __m128i*)(rgba + i*4));
+        __m128 r = _mm_cvtepi32_ps(_mm_and_si128(px, byte));
+        __m128 g = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px, 8), byte));
+        __m128 b = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(px, 16), byte));
+        __m128 s = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, r), _mm_mul_ps(g, g)), _mm_mul_ps(b, b));
+        __m128 v = _mm_min_ps(_mm_sqrt_ps(_mm_mul_ps(s, vfactor)), white);
+        _mm_store_si128((__m128i*)level, _mm_cvttps_epi32(_mm_add_ps(v, half)));
+        for(int k=0;k<4;++k) gray[i+k] = (sf::Uint8)level[k];
+    }
+#endif
+    for(;i<count;++i)
+    {
+        const sf::Uint8* p = rgba + i*4;
+        float s = float(p[0]*p[0] + p[1]*p[1] + p[2]*p[2]);
+        gray[i] = (sf::Uint8)(std::min(std::sqrt(s*factor), 255.0f) + 0.5f);
+    }
+}
+
+// --------------------------------------------------------------------------
+const sf::Image& ImageConversion::computeGrayscale(const sf::Image& image, GrayscaleMode mode)
+{
+    sf::Vector2u size = image.getSize();
+    const sf::Uint8* src = image.getPixelsPtr();
+    std::vector<sf::Uint8> pixels(size.x*size.y*4);
+
+    parallelFor(0, size.y, [&](unsigned int y0, unsigned int y1)
+    {
+        std::vector<sf::Uint8> gray(size.x);
+        for(unsigned int y=y0;y<y1;++y)
+        {
+            grayscale(src + y*size.x*4, gray.data(), size.x, mode);
+            sf::Uint8* dst = &pixels[y*size.x*4];
+            for(unsigned int x=0;x<size.x;++x)
+            {
+                dst[x*4] = gray[x]; dst[x*4+1] = gray[x]; dst[x*4+2] = gray[x]; dst[x*4+3] = 255;
+            }
+        }
+    });
+
+    m_image.create(size.x, size.y, pixels.data());
+    return m_image;
+}
+
+// --------------------------------------------------------------------------
+const ImageBuffer<sf::Uint8>& ImageConversion::computeGrayscale(const ImageBuffer<sf::Uint8>& buffer, GrayscaleMode mode)
+{
+    unsigned int w = buffer.width(), ch = buffer.channels();
+    m_buffer.create(w, buffer.height(), 1);
+
+    parallelFor(0, buffer.height(), [&](unsigned int y0, unsigned int y1)
+    {
+        // rows of other layouts are expanded to RGBA first
+        std::vector<sf::Uint8> rgba(ch == 4 ? 0 : w*4);
+        for(unsigned int y=y0;y<y1;++y)
+        {
+            const sf::Uint8* src = buffer.row(y);
+            if(ch != 4)
+            {
+                for(unsigned int x=0;x<w;++x)
+                {
+                    const sf::Uint8* p = src + x*ch;
+                    sf::Uint8* d = &rgba[x*4];
+                    if(ch < 3) { d[0] = d[1] = d[2] = p[0]; } else { d[0] = p[0]; d[1] = p[1]; d[2] = p[2]; }
+                    d[3] = 255;
+                }
+                src = rgba.data();
+            }
+            grayscale(src, m_buffer.row(y), w, mode);
+        }
+    });
+
+    return m_buffer;
+}
+
+// --------------------------------------------------------------------------
+// fixed point resampling : weights of each output sum to 1 << s_weightBits, the
+// intermediate rows keep s_interBits fractional bits of the levels
+static const int s_weightBits = 14;
+static const int s_interBits = 6;
+
+// --------------------------------------------------------------------------
+struct ResampleTable
+{
+    unsigned int taps;                  // taps per output (unused ones have a zero weight)
+    std::vector<int> index;             // clamped source index, output-major
+    std::vector<sf::Int16> weights;
+};
+
+// --------------------------------------------------------------------------
+static double cubicKernel(double x)
+{
+    x = std::abs(x);
+    if(x < 1.0) return (1.5*x - 2.5)*x*x + 1.0;
+    if(x < 2.0) return ((-0.5*x + 2.5)*x - 4.0)*x + 2.0;
+    return 0.0;
+}
+
+// --------------------------------------------------------------------------
+static double lanczos3Kernel(double x)
+{
+    const double pi = 3.14159265358979323846;
+    x = std::abs(x);
+    if(x < 1e-9) return 1.0;
+    if(x >= 3.0) return 0.0;
+    double px = pi*x;
+    return 3.0 * std::sin(px) * std::sin(px/3.0) / (px*px);
+}
+
+// --------------------------------------------------------------------------
+static void buildResampleTable(int srcLength, int dstLength, ImageConversion::ResizeFilter filter, ResampleTable& table)
+{
+    double scale = double(srcLength) / dstLength;
+    std::vector< std::vector< std::pair<int,double> > > taps(dstLength);
+
+    for(int i=0;i<dstLength;++i)
+    {
+        if(filter == ImageConversion::Area)
+        {
+            // coverage of the source pixels by the output footprint
+            double a = i*scale, b = (i+1)*scale;
+            for(int j=int(std::floor(a));j<int(std::ceil(b));++j)
+            {
+                double w = std::min(b, j+1.0) - std::max(a, double(j));
+                if(w > 0.0) taps[i].push_back(std::make_pair(j, w));
+            }
+        }
+        else
+        {
+            double radius = (filter == ImageConversion::Bicubic) ? 2.0 : 3.0;
+            double stretch = std::max(scale, 1.0);
+            double center = (i+0.5)*scale - 0.5;
+            int j0 = int(std::floor(center - radius*stretch)) + 1;
+            int j1 = int(std::floor(center + radius*stretch));
+            for(int j=j0;j<=j1;++j)
+            {
+                double x = (j-center)/stretch;
+                double w = (filter == ImageConversion::Bicubic) ? cubicKernel(x) : lanczos3Kernel(x);
+                if(w != 0.0) taps[i].push_back(std::make_pair(std::min(std::max(j, 0), srcLength-1), w));
+            }
+        }
+    }
+
+    table.taps = 1;
+    for(const auto& t : taps) table.taps = std::max<unsigned int>(table.taps, t.size());
+    table.index.assign(dstLength*table.taps, 0);
+    table.weights.assign(dstLength*table.taps, 0);
+
+    for(int i=0;i<dstLength;++i)
+    {
+        // normalized then rounded, the rounding residual going to the largest tap
+        double sum = 0.0;
+        for(const auto& t : taps[i]) sum += t.second;
+
+        int total = 0, largest = 0;
+        for(unsigned int k=0;k<taps[i].size();++k)
+        {
+            int w = (int)std::lround(taps[i][k].second / sum * (1 << s_weightBits));
+            table.index[i*table.taps+k] = taps[i][k].first;
+            table.weights[i*table.taps+k] = (sf::Int16)w;
+            total += w;
+            if(std::abs(w) > std::abs(table.weights[i*table.taps+largest])) largest = k;
+        }
+        table.weights[i*table.taps+largest] += (1 << s_weightBits) - total;
+        for(unsigned int k=taps[i].size();k<table.taps;++k) table.index[i*table.taps+k] = table.index[i*table.taps];
+    }
+}
+
+// --------------------------------------------------------------------------
+// integer factors : sums of fx x fy blocks
+static void blockAverage(const ImageBuffer<sf::Uint8>& src, ImageBuffer<sf::Uint8>& dst)
+{
+    unsigned int fx = src.width() / dst.width(), fy = src.height() / dst.height();
+    unsigned int n = fx*fy, ch = src.channels();
+    unsigned int lineSize = dst.width()*ch;
+
+    parallelFor(0, dst.height(), [&](unsigned int y0, unsigned int y1)
+    {
+        std::vector<unsigned int> sums(lineSize);
+        for(unsigned int y=y0;y<y1;++y)
+        {
+            std::fill(sums.begin(), sums.end(), 0);
+            for(unsigned int j=0;j<fy;++j)
+            {
+                const sf::Uint8* row = src.row(y*fy+j);
+                for(unsigned int x=0;x<dst.width();++x)
+                {
+                    const sf::Uint8* p = row + x*fx*ch;
+                    unsigned int* s = &sums[x*ch];
+                    for(unsigned int i=0;i<fx;++i,p+=ch) for(unsigned int c=0;c<ch;++c) s[c] += p[c];
+                }
+            }
+            sf::Uint8* out = dst.row(y);
+            for(unsigned int i=0;i<lineSize;++i) out[i] = (sf::Uint8)((sums[i] + n/2) / n);
+        }
+    });
+}
+
+// --------------------------------------------------------------------------
+// resampling of src to the size of dst, same channels
+static void resample(const ImageBuffer<sf::Uint8>& src, ImageBuffer<sf::Uint8>& dst, ImageConversion::ResizeFilter filter)
+{
+    sf::Vector2u size = src.size(), newsize = dst.size();
+    const unsigned int ch = src.channels();
+
+    if(filter == ImageConversion::Area && size.x % newsize.x == 0 && size.y % newsize.y == 0)
+    {
+        blockAverage(src, dst);
+        return;
+    }
+
+    ResampleTable columns, rows;
+    buildResampleTable(size.x, newsize.x, filter, columns);
+    buildResampleTable(size.y, newsize.y, filter, rows);
+
+    // horizontal pass of a source row, levels with s_interBits fractional bits
+    const unsigned int lineSize = newsize.x*ch;
+    auto horizontalRow = [&](unsigned int y, sf::Int16* out)
+    {
+        const sf::Uint8* row = src.row(y);
+        for(unsigned int x=0;x<newsize.x;++x)
+        {
+            const int* index = &columns.index[x*columns.taps];
+            const sf::Int16* weights = &columns.weights[x*columns.taps];
+            int acc[4] = {0, 0, 0, 0};
+            for(unsigned int t=0;t<columns.taps;++t)
+            {
+                const sf::Uint8* p = row + index[t]*ch;
+                int w = weights[t];
+                for(unsigned int c=0;c<ch;++c) acc[c] += w*p[c];
+            }
+            const int shift = s_weightBits - s_interBits;
+            for(unsigned int c=0;c<ch;++c) out[x*ch+c] = (sf::Int16)((acc[c] + (1 << (shift-1))) >> shift);
+        }
+    };
+
+    // source rows spanned by an output row : size of the ring of horizontal rows, so
+    // the rows of one output never share a slot
+    unsigned int span = 1;
+    for(unsigned int y=0;y<newsize.y;++y)
+    {
+        const int* index = &rows.index[y*rows.taps];
+        auto range = std::minmax_element(index, index+rows.taps);
+        span = std::max(span, (unsigned int)(*range.second - *range.first + 1));
+    }
+
+    // vertical pass : whole rows, 8 values per register. Each band streams the source
+    // rows it needs through its ring (source indices only grow with the output row)
+    const int shift = s_weightBits + s_interBits;
+    parallelFor(0, newsize.y, [&](unsigned int y0, unsigned int y1)
+    {
+        std::vector<sf::Int16> ring(span*lineSize);
+        std::vector<int> loaded(span, -1);
+        std::vector<const sf::Int16*> lines(rows.taps);
+
+        for(unsigned int y=y0;y<y1;++y)
+        {
+            const int* index = &rows.index[y*rows.taps];
+            const sf::Int16* weights = &rows.weights[y*rows.taps];
+            sf::Uint8* out = dst.row(y);
+
+            for(unsigned int t=0;t<rows.taps;++t)
+            {
+                unsigned int slot = index[t] % span;
+                if(loaded[slot] != index[t]) { horizontalRow(index[t], &ring[slot*lineSize]); loaded[slot] = index[t]; }
+                lines[t] = &ring[slot*lineSize];
+            }
+
+            unsigned int i = 0;
+
+#if defined(ANALYSIS_SIMD_SSE)
+            const __m128i round = _mm_set1_epi32(1 << (shift-1));
+            for(;i+8<=lineSize;i+=8)
+            {
+                __m128i acc0 = _mm_setzero_si128(), acc1 = _mm_setzero_si128();
+                for(unsigned int t=0;t<rows.taps;++t)
+                {
+                    __m128i v = _mm_loadu_si128((const __m128i*)(lines[t] + i));
+                    __m128i w = _mm_set1_epi16(weights[t]);
+                    __m128i lo = _mm_mullo_epi16(v, w), hi = _mm_mulhi_epi16(v, w);
+                    acc0 = _mm_add_epi32(acc0, _mm_unpacklo_epi16(lo, hi));
+                    acc1 = _mm_add_epi32(acc1, _mm_unpackhi_epi16(lo, hi));
+                }
+                acc0 = _mm_srai_epi32(_mm_add_epi32(acc0, round), shift);
+                acc1 = _mm_srai_epi32(_mm_add_epi32(acc1, round), shift);
+                __m128i packed = _mm_packs_epi32(acc0, acc1);
+                _mm_storel_epi64((__m128i*)(out + i), _mm_packus_epi16(packed, packed));
+            }
+#endif
+            for(;i<lineSize;++i)
+            {
+                int acc = 0;
+                for(unsigned int t=0;t<rows.taps;++t) acc += weights[t] * lines[t][i];
+                acc = (acc + (1 << (shift-1))) >> shift;
+                out[i] = (sf::Uint8)std::min(std::max(acc, 0), 255);
+            }
+        }
+    });
+}
+
+// --------------------------------------------------------------------------
+const sf::Image& ImageConversion::computeResizing(const sf::Image& image, const sf::Vector2u& newsize, ResizeFilter filter)
+{
+    sf::Vector2u size = image.getSize();
+    if(newsize.x == 0 || newsize.y == 0 || size.x == 0 || size.y == 0)
+    {
+        m_image.create(newsize.x, newsize.y);
+        return m_image;
+    }
+
+    // written in place in the pixels of the result
+    std::vector<sf::Uint8> pixels(newsize.x*newsize.y*4);
+    ImageBuffer<sf::Uint8> dst(pixels.data(), newsize.x, newsize.y, 4, newsize.x*4);
+    resample(imageView(image), dst, filter);
+
+    m_image.create(newsize.x, newsize.y, pixels.data());
+    return m_image;
+}
+
+// --------------------------------------------------------------------------
+const ImageBuffer<sf::Uint8>& ImageConversion::computeResizing(const ImageBuffer<sf::Uint8>& buffer, const sf::Vector2u& newsize, ResizeFilter filter)
+{
+    m_buffer.create(newsize.x, newsize.y, buffer.channels());
+    if(newsize.x == 0 || newsize.y == 0) return m_buffer;
+
+    if(buffer.empty()) m_buffer.fill(0);
+    else resample(buffer, m_buffer, filter);
+    return m_buffer;
+}
+
+// --------------------------------------------------------------------------
+const sf::Image& ImageConversion::getResultAsImage()
+{
+    return m_image;
+}
@@ -3,6 +3,8 @@
 
 #include <SFML/Graphics.hpp>
 
+#include "imageBuffer.hpp"
+
 // --------------------------------------------------------------------------
 // Helper class - give functions for texture conversion
 class TextureConversion
@@ -34,4 +36,58 @@ protected:
     sf::Shader m_resizeShader;          // shader for resizing
 };
 
+// --------------------------------------------------------------------------
+// Helper class - same conversions on images with the CPU (no GL context needed),
+// rows split between the workers
+class ImageConversion
+{
+public:
+
+    enum GrayscaleMode
+    {
+        Luminance,      // sRGB decoded, Rec.709 weighted, sRGB encoded (grayscale shader)
+        Length,         // length of the color, saturated (grayscale2 shader)
+        QuadraticMean   // quadratic mean of the channels (grayscale3 shader)
+    };
+
+    enum ResizeFilter
+    {
+        Area,           // average of the covered source pixels (box decimation)
+        Bicubic,        // Keys cubic, a = -0.5
+        Lanczos3        // windowed sinc, 3 lobes
+    };
+
+    ImageConversion();
+    virtual ~ImageConversion();
+
+    void initialize();
+    void cleanup();
+
+    // compute a grayscale image from a given image, within 1 level of the shaders
+    const sf::Image& computeGrayscale( const sf::Image& image, GrayscaleMode mode = Luminance );
+
+    // single channel gray levels of a buffer (1 or 2 channels are already gray, alpha is ignored)
+    const ImageBuffer<sf::Uint8>& computeGrayscale( const ImageBuffer<sf::Uint8>& buffer, GrayscaleMode mode = Luminance );
+
+    // gray level of count RGBA8 pixels
+    static void grayscale( const sf::Uint8* rgba, sf::Uint8* gray, unsigned int count, GrayscaleMode mode = Luminance );
+
+    // compute a resized image from a given image : separable resampling with fixed point
+    // weights and integer arithmetic, so the result doesn't depend on the host. Filters are
+    // widened by the scale when downscaling (no aliasing), integer factors with the Area
+    // filter are plain block averages
+    const sf::Image& computeResizing( const sf::Image& image, const sf::Vector2u& newsize, ResizeFilter filter = Lanczos3 );
+
+    // same on a buffer, the result having its channels
+    const ImageBuffer<sf::Uint8>& computeResizing( const ImageBuffer<sf::Uint8>& buffer, const sf::Vector2u& newsize, ResizeFilter filter = Lanczos3 );
+
+    // get result image
+    const sf::Image& getResultAsImage();
+
+protected:
+
+    sf::Image m_image;                  // result image
+    ImageBuffer<sf::Uint8> m_buffer;    // result buffer
+};
+
 #endif // TEXTURE_CONVERSION_HPP
@@ -0,0 +1,217 @@
+#include "cpuBackend.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// --------------------------------------------------------------------------
+static unsigned int s_workerCount = 0;
+
+// --------------------------------------------------------------------------
+void setWorkerCount(unsigned int count)
+{
+    s_workerCount = count;
+}
+
+// --------------------------------------------------------------------------
+unsigned int workerCount()
+{
+    if(s_workerCount > 0) return s_workerCount;
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// --------------------------------------------------------------------------
+// Helper class - persistent worker threads running the chunks of parallelFor,
+// woken for each call instead of being created and joined every time
+class WorkerPool
+{
+public:
+    typedef std::function<void(unsigned int, unsigned int)> Job;
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for(auto& t : m_threads) t.join();
+    }
+
+    // chunks 1..n-1 on the workers, the first one on the calling thread
+    void run(unsigned int begin, unsigned int end, unsigned int n, const Job& job)
+    {
+        std::lock_guard<std::mutex> submit(m_submit);
+        while(m_threads.size() < n-1)
+        {
+            unsigned int index = m_threads.size();
+            m_threads.emplace_back([this, index]{ work(index); });
+        }
+
+        unsigned int chunk = (end - begin + n - 1) / n;
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_job = &job;
+            m_begin = begin; m_end = end; m_chunk = chunk; m_chunks = n;
+            m_pending = n-1;
+            ++m_generation;
+        }
+        m_wake.notify_all();
+
+        s_inside = true;
+        job(begin, std::min(end, begin + chunk));
+        s_inside = false;
+
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_done.wait(lock, [this]{ return m_pending == 0; });
+        m_job = nullptr;
+    }
+
+    // calls made from a chunk run inline
+    static thread_local bool s_inside;
+
+private:
+    void work(unsigned int index)
+    {
+        s_inside = true;
+        unsigned long long seen = 0;
+        for(;;)
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_wake.wait(lock, [&]{ return m_stop || m_generation != seen; });
+            if(m_stop) return;
+            seen = m_generation;
+
+            unsigned int i = index + 1;
+            if(i >= m_chunks) continue;
+            const Job& job = *m_job;
+            unsigned int b = m_begin + i*m_chunk;
+            unsigned int e = std::min(m_end, b + m_chunk);
+            lock.unlock();
+
+            if(b < e) job(b, e);
+
+            lock.lock();
+            if(--m_pending == 0) m_done.notify_one();
+        }
+    }
+
+    std::vector<std::thread> m_threads;
+    std::mutex m_submit;                // one parallelFor at a time on the workers
+    std::mutex m_lock;
+    std::condition_variable m_wake, m_done;
+    const Job* m_job = nullptr;
+    unsigned int m_begin = 0, m_end = 0, m_chunk = 0, m_chunks = 0;
+    unsigned int m_pending = 0;
+    unsigned long long m_generation = 0;
+    bool m_stop = false;
+};
+
+thread_local bool WorkerPool::s_inside = false;
+
+// --------------------------------------------------------------------------
+void parallelFor(unsigned int begin, unsigned int end, const std::function<void(unsigned int, unsigned int)>& job)
+{
+    if(end <= begin) return;
+
+    unsigned int count = end - begin;
+    unsigned int n = std::min(workerCount(), count);
+    if(n <= 1 || WorkerPool::s_inside) { job(begin, end); return; }
+
+    static WorkerPool pool;
+    pool.run(begin, end, n, job);
+}
+
+// --------------------------------------------------------------------------
+void imageToBuffer(const sf::Image& image, std::vector<float>& buffer)
+{
+    sf::Vector2u size = image.getSize();
+    unsigned int n = size.x*size.y*4;
+    buffer.resize(n);
+
+    const sf::Uint8* px = image.getPixelsPtr();
+    if(px == nullptr) return;
+
+    parallelFor(0, size.y, [&](unsigned int y0, unsigned int y1)
+    {
+        for(unsigned int i=y0*size.x*4; i<y1*size.x*4; ++i) buffer[i] = px[i] / 255.0f;
+    });
+}
+
+// --------------------------------------------------------------------------
+void bufferToImage(const std::vector<float>& buffer, const sf::Vector2u& size, sf::Image& image)
+{
+    std::vector<sf::Uint8> px(size.x*size.y*4);
+
+    parallelFor(0, size.y, [&](unsigned int y0, unsigned int y1)
+    {
+        for(unsigned int i=y0*size.x*4; i<y1*size.x*4; ++i)
+        {
+            float v = std::min(std::max(buffer[i], 0.0f), 1.0f);
+            px[i] = sf::Uint8(v * 255.0f + 0.5f);
+        }
+    });
+
+    image.create(size.x, size.y, px.data());
+}
+
+// --------------------------------------------------------------------------
+sf::IntRect apronWindow(sf::IntRect& roi, unsigned int apron, const sf::Vector2u& size)
+{
+    int x0 = std::max(roi.left, 0), y0 = std::max(roi.top, 0);
+    int x1 = std::min(roi.left+roi.width, int(size.x)), y1 = std::min(roi.top+roi.height, int(size.y));
+    if(x1 <= x0 || y1 <= y0) { roi = sf::IntRect(); return sf::IntRect(); }
+
+    int a = apron;
+    sf::IntRect window(std::max(x0-a, 0), std::max(y0-a, 0), 0, 0);
+    window.width = std::min(x1+a, int(size.x)) - window.left;
+    window.height = std::min(y1+a, int(size.y)) - window.top;
+
+    roi = sf::IntRect(x0-window.left, y0-window.top, x1-x0, y1-y0);
+    return window;
+}
+
+// --------------------------------------------------------------------------
+void imageToBuffer(const sf::Image& image, const sf::IntRect& window, std::vector<float>& buffer)
+{
+    unsigned int w = window.width, n = w*4;
+    buffer.resize(w*window.height*4);
+    if(buffer.empty()) return;
+
+    const sf::Uint8* px = image.getPixelsPtr();
+    unsigned int stride = image.getSize().x*4;
+
+    parallelFor(0, window.height, [&](unsigned int y0, unsigned int y1)
+    {
+        for(unsigned int y=y0;y<y1;++y)
+        {
+            const sf::Uint8* src = px + (window.top+y)*stride + window.left*4;
+            float* dst = &buffer[y*n];
+            for(unsigned int i=0;i<n;++i) dst[i] = src[i] / 255.0f;
+        }
+    });
+}
+
+// --------------------------------------------------------------------------
+void bufferToImage(const std::vector<float>& buffer, const sf::Vector2u& size, const sf::IntRect& region, sf::Image& image)
+{
+    unsigned int n = region.width*4;
+    std::vector<sf::Uint8> px(region.width*region.height*4);
+
+    parallelFor(0, region.height, [&](unsigned int y0, unsigned int y1)
+    {
+        for(unsigned int y=y0;y<y1;++y)
+        {
+            const float* src = &buffer[((region.top+y)*size.x + region.left)*4];
+            sf::Uint8* dst = &px[y*n];
+            for(unsigned int i=0;i<n;++i)
+            {
+                float v = std::min(std::max(src[i], 0.0f), 1.0f);
+                dst[i] = sf::Uint8(v * 255.0f + 0.5f);
+            }
+        }
+    });
+
+    image.create(region.width, region.height, px.data());
+}
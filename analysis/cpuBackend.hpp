@@ -0,0 +1,41 @@
+#ifndef CPU_BACKEND_HPP
+#define CPU_BACKEND_HPP
+
+#include <SFML/Graphics.hpp>
+
+#include <functional>
+#include <vector>
+
+// --------------------------------------------------------------------------
+// SIMD code paths available at compile time (scalar code is used otherwise)
+#if defined(__AVX__)
+    #define ANALYSIS_SIMD_AVX
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define ANALYSIS_SIMD_SSE
+#endif
+
+// --------------------------------------------------------------------------
+// Helper functions - CPU execution backend (no GL context needed)
+
+// number of worker threads used by parallelFor (0 = hardware concurrency)
+void setWorkerCount(unsigned int count);
+unsigned int workerCount();
+
+// split [begin,end) in contiguous chunks and run them on worker threads
+void parallelFor(unsigned int begin, unsigned int end, const std::function<void(unsigned int, unsigned int)>& job);
+
+// RGBA8 image <-> RGBA float buffer (row-major, values in [0,1])
+void imageToBuffer(const sf::Image& image, std::vector<float>& buffer);
+void bufferToImage(const std::vector<float>& buffer, const sf::Vector2u& size, sf::Image& image);
+
+// region of interest grown by an apron on each side, both clipped to the image : the
+// window holds the source pixels a region needs, the region is then relative to it
+sf::IntRect apronWindow(sf::IntRect& roi, unsigned int apron, const sf::Vector2u& size);
+
+// window of an image as a RGBA float buffer of the window size, and region of
+// a RGBA float buffer as an image of the region size
+void imageToBuffer(const sf::Image& image, const sf::IntRect& window, std::vector<float>& buffer);
+void bufferToImage(const std::vector<float>& buffer, const sf::Vector2u& size, const sf::IntRect& region, sf::Image& image);
+
+#endif // CPU_BACKEND_HPP
@@ -0,0 +1,236 @@
+#include "distanceTransform.hpp"
+
+#include "cpuBackend.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+// --------------------------------------------------------------------------
+const unsigned int DistanceTransform::noFeature = UINT_MAX;
+
+// --------------------------------------------------------------------------
+// lower envelope of the parabolas (q-p)^2 + f(q) for the finite f(q), sampled
+// on [0,n). v : parabola vertices, z : boundaries between them
+static void lowerEnvelope(const unsigned int* f, unsigned int* d, int n,
+                          std::vector<int>& v, std::vector<double>& z)
+{
+    v.resize(n);
+    z.resize(n+1);
+
+    int k = -1;
+    for(int q=0;q<n;++q)
+    {
+        unsigned int fq = f[q];
+        if(fq == DistanceTransform::noFeature) continue;
+
+        double s = -INFINITY;
+        while(k >= 0)
+        {
+            int p = v[k];
+            double fp = f[p];
+            s = ((fq + double(q)*q) - (fp + double(p)*p)) / (2.0*(q-p));
+            if(s > z[k]) break;
+            --k;
+        }
+        ++k;
+        v[k] = q;
+        z[k] = (k == 0) ? -INFINITY : s;
+        z[k+1] = INFINITY;
+    }
+
+    if(k < 0)
+    {
+        for(int q=0;q<n;++q) d[q] = DistanceTransform::noFeature;
+        return;
+    }
+
+    int j = 0;
+    for(int q=0;q<n;++q)
+    {
+        while(z[j+1] < q) ++j;
+        long long dq = q - v[j];
+        unsigned long long value = dq*dq + (unsigned long long)f[v[j]];
+        d[q] = (unsigned int)std::min<unsigned long long>(value, DistanceTransform::noFeature-1);
+    }
+}
+
+// --------------------------------------------------------------------------
+DistanceTransform::DistanceTransform()
+{
+    initialize();
+}
+
+// --------------------------------------------------------------------------
+DistanceTransform::~DistanceTransform()
+{
+    cleanup();
+}
+
+// --------------------------------------------------------------------------
+void DistanceTransform::initialize()
+{
+}
+
+// --------------------------------------------------------------------------
+void DistanceTransform::cleanup()
+{
+}
+
+// --------------------------------------------------------------------------
+void DistanceTransform::process(const std::vector<sf::Uint8>& features, unsigned int width, unsigned int height)
+{
+    m_size = sf::Vector2u(width, height);
+    m_distances.resize(width*height);
+    const int w = width, h = height;
+
+    // rows : squared distance to the nearest feature of the row, two scans
+    parallelFor(0, height, [&](unsigned int y0, unsigned int y1)
+    {
+        for(unsigned int y=y0;y<y1;++y)
+        {
+            const sf::Uint8* f = features.data() + y*w;
+            unsigned int* d = m_distances.data() + y*w;
+
+            int last = -1;
+            for(int x=0;x<w;++x)
+            {
+                if(f[x]) last = x;
+                d[x] = last < 0 ? noFeature : x-last;
+            }
+            last = -1;
+            for(int x=w-1;x>=0;--x)
+            {
+                if(f[x]) last = x;
+                if(last >= 0 && unsigned(last-x) < d[x]) d[x] = last-x;
+                if(d[x] != noFeature) d[x] = d[x]*d[x];
+            }
+        }
+    });
+
+    // columns : lower envelope of the row distances
+    parallelFor(0, width, [&](unsigned int x0, unsigned int x1)
+    {
+        std::vector<int> v;
+        std::vector<double> z;
+        std::vector<unsigned int> column(h), result(h);
+        for(unsigned int x=x0;x<x1;++x)
+        {
+            for(int y=0;y<h;++y) column[y] = m_distances[y*w+x];
+            lowerEnvelope(column.data(), result.data(), h, v, z);
+            for(int y=0;y<h;++y) m_distances[y*w+x] = result[y];
+        }
+    });
+}
+
+// --------------------------------------------------------------------------
+void DistanceTransform::compute(const ImageBuffer<sf::Uint8>& buffer, sf::Uint8 threshold, bool foreground)
+{
+    unsigned int w = buffer.width(), h = buffer.height(), ch = buffer.channels();
+    m_features.resize(w*h);
+    for(unsigned int y=0;y<h;++y)
+    {
+        const sf::Uint8* px = buffer.row(y);
+        for(unsigned int x=0;x<w;++x) m_features[y*w+x] = ((px[x*ch] > threshold) == foreground) ? 1 : 0;
+    }
+
+    process(m_features, w, h);
+}
+
+// --------------------------------------------------------------------------
+const sf::Image& DistanceTransform::apply(const sf::Image& image, sf::Uint8 threshold)
+{
+    compute(imageView(image), threshold, false);
+
+    std::vector<sf::Uint8> pixels(m_distances.size()*4);
+    parallelFor(0, m_size.y, [&](unsigned int y0, unsigned int y1)
+    {
+        for(unsigned int i=y0*m_size.x;i<y1*m_size.x;++i)
+        {
+            float d = m_distances[i] == noFeature ? 255.f : std::sqrt(float(m_distances[i]));
+            sf::Uint8 v = (sf::Uint8)std::min(d, 255.f);
+            pixels[i*4] = v; pixels[i*4+1] = v; pixels[i*4+2] = v; pixels[i*4+3] = 255;
+        }
+    });
+    m_image.create(m_size.x, m_size.y, pixels.data());
+    return m_image;
+}
+
+// --------------------------------------------------------------------------
+void DistanceTransform::thresholdDisk(float radius, bool inside)
+{
+    // integer squared distances : d^2 <= r^2 <=> d^2 <= floor(r^2)
+    double r2 = std::floor(double(radius)*radius);
+    unsigned int limit = r2 < 0.0 ? 0 : (unsigned int)std::min(r2, double(noFeature-1));
+
+    m_mask.create(m_size.x, m_size.y, 1);
+    parallelFor(0, m_size.y, [&](unsigned int y0, unsigned int y1)
+    {
+        for(unsigned int y=y0;y<y1;++y)
+        {
+            const unsigned int* d = &m_distances[y*m_size.x];
+            sf::Uint8* out = m_mask.row(y);
+            for(unsigned int x=0;x<m_size.x;++x) out[x] = ((d[x] <= limit) == inside) ? 255 : 0;
+        }
+    });
+}
+
+// --------------------------------------------------------------------------
+const sf::Image& DistanceTransform::dilate(const sf::Image& image, float radius, sf::Uint8 threshold)
+{
+    dilate(imageView(image), radius, threshold);
+    bufferToImage(m_mask, m_image);
+    return m_image;
+}
+
+// --------------------------------------------------------------------------
+const sf::Image& DistanceTransform::erode(const sf::Image& image, float radius, sf::Uint8 threshold)
+{
+    erode(imageView(image), radius, threshold);
+    bufferToImage(m_mask, m_image);
+    return m_image;
+}
+
+// --------------------------------------------------------------------------
+const ImageBuffer<float>& DistanceTransform::apply(const ImageBuffer<sf::Uint8>& buffer, sf::Uint8 threshold)
+{
+    compute(buffer, threshold, false);
+
+    m_distanceMap.create(m_size.x, m_size.y, 1);
+    parallelFor(0, m_size.y, [&](unsigned int y0, unsigned int y1)
+    {
+        for(unsigned int y=y0;y<y1;++y) for(unsigned int x=0;x<m_size.x;++x) m_distanceMap.at(x,y) = distance(x,y);
+    });
+    return m_distanceMap;
+}
+
+// --------------------------------------------------------------------------
+const ImageBuffer<sf::Uint8>& DistanceTransform::dilate(const ImageBuffer<sf::Uint8>& buffer, float radius, sf::Uint8 threshold)
+{
+    // within the radius of a foreground pixel
+    compute(buffer, threshold, true);
+    thresholdDisk(radius, true);
+    return m_mask;
+}
+
+// --------------------------------------------------------------------------
+const ImageBuffer<sf::Uint8>& DistanceTransform::erode(const ImageBuffer<sf::Uint8>& buffer, float radius, sf::Uint8 threshold)
+{
+    // farther than the radius from any background pixel
+    compute(buffer, threshold, false);
+    thresholdDisk(radius, false);
+    return m_mask;
+}
+
+// --------------------------------------------------------------------------
+float DistanceTransform::distance(unsigned int x, unsigned int y) const
+{
+    unsigned int d = m_distances[y*m_size.x+x];
+    return d == noFeature ? INFINITY : std::sqrt(float(d));
+}
+
+// --------------------------------------------------------------------------
+const sf::Image& DistanceTransform::getResultAsImage()
+{
+    return m_image;
+}
@@ -0,0 +1,63 @@
+#ifndef DISTANCE_TRANSFORM_HPP
+#define DISTANCE_TRANSFORM_HPP
+
+#include <SFML/Graphics.hpp>
+
+#include "imageBuffer.hpp"
+
+// --------------------------------------------------------------------------
+// Helper class - exact euclidean distance transform (Felzenszwalb-Huttenlocher) :
+// a 1D distance per row then the lower envelope of parabolas per column, both
+// linear and split between the workers. Disk morphology of any radius is a
+// threshold of it.
+class DistanceTransform
+{
+public:
+    DistanceTransform();
+    virtual ~DistanceTransform();
+
+    void initialize();
+    void cleanup();
+
+    // squared distance of each pixel to the nearest feature pixel (non zero value, row-major),
+    // noFeature when there is none
+    void process( const std::vector<sf::Uint8>& features, unsigned int width, unsigned int height );
+
+    // distance map of a binary image (red channel above the threshold) : distance of the
+    // foreground pixels to the nearest background one, clamped to 255
+    const sf::Image& apply( const sf::Image& image, sf::Uint8 threshold = 127 );
+
+    // disk dilation and erosion of a binary image, white on black results. Outside of the
+    // image is neither foreground nor background (same as replicated borders)
+    const sf::Image& dilate( const sf::Image& image, float radius, sf::Uint8 threshold = 127 );
+    const sf::Image& erode( const sf::Image& image, float radius, sf::Uint8 threshold = 127 );
+
+    // same on the first channel of a buffer : distances (infinite without background) and
+    // single channel masks (255 for set pixels)
+    const ImageBuffer<float>& apply( const ImageBuffer<sf::Uint8>& buffer, sf::Uint8 threshold = 127 );
+    const ImageBuffer<sf::Uint8>& dilate( const ImageBuffer<sf::Uint8>& buffer, float radius, sf::Uint8 threshold = 127 );
+    const ImageBuffer<sf::Uint8>& erode( const ImageBuffer<sf::Uint8>& buffer, float radius, sf::Uint8 threshold = 127 );
+
+    const std::vector<unsigned int>& getSquaredDistances() const {return m_distances;}
+    float distance(unsigned int x, unsigned int y) const;
+
+    const sf::Image& getResultAsImage();
+
+    static const unsigned int noFeature;
+
+protected:
+    // features : pixels whose first channel is above the threshold (foreground) or not
+    void compute(const ImageBuffer<sf::Uint8>& buffer, sf::Uint8 threshold, bool foreground);
+
+    // m_mask : pixels whose squared distance is at most r^2, or above it
+    void thresholdDisk(float radius, bool inside);
+
+    sf::Vector2u m_size;
+    std::vector<sf::Uint8> m_features;
+    std::vector<unsigned int> m_distances;
+    sf::Image m_image;
+    ImageBuffer<float> m_distanceMap;
+    ImageBuffer<sf::Uint8> m_mask;
+};
+
+#endif // DISTANCE_TRANSFORM_HPP
@@ -1,5 +1,7 @@
 #include "doubleThreshold.hpp"
 
+#include "cpuBackend.hpp"
+
 #include <iostream>
 
 // --------------------------------------------------------------------------
@@ -41,6 +43,7 @@ static const std::string s_glsl_2thresholds = GLSL_CODE(
 
 // --------------------------------------------------------------------------
 DoubleThreshold::DoubleThreshold()
+    : m_mode(ThreeValues)
 {
     initialize();
 }
@@ -68,6 +71,12 @@ void DoubleThreshold::cleanup()
 {
 }
 
+// --------------------------------------------------------------------------
+void DoubleThreshold::setOutputMode(OutputMode mode)
+{
+    m_mode = mode;
+}
+
 // --------------------------------------------------------------------------
 void DoubleThreshold::resizeRenderTarget(const sf::Vector2u& size)
 {
@@ -101,11 +110,166 @@ const sf::Texture& DoubleThreshold::apply(const sf::Texture &texture, float thre
     m_target.clear();
     m_target.draw(m_vertexBuffer, &m_2thresholdShader);
 
+    if(m_mode == Edges)
+    {
+        m_edges.loadFromImage( m_hysteresis.apply(m_target.getTexture().copyToImage()) );
+        return m_edges;
+    }
+
     return m_target.getTexture();
 }
 
+// --------------------------------------------------------------------------
+// first channel of each pixel over its full range, against two thresholds
+template<typename T>
+static void classify(const ImageBuffer<T>& buffer, float range, float thresholdMajor, float thresholdMinor, std::vector<sf::Uint8>& classes)
+{
+    sf::Vector2u size = buffer.size();
+    unsigned int ch = buffer.channels();
+    classes.resize(size.x*size.y);
+
+    parallelFor(0, size.y, [&](unsigned int y0, unsigned int y1)
+    {
+        for(unsigned int y=y0;y<y1;++y)
+        {
+            const T* src = buffer.row(y);
+            sf::Uint8* cls = &classes[y*size.x];
+            for(unsigned int x=0;x<size.x;++x)
+            {
+                float v = src[x*ch] / range;
+                cls[x] = 0;
+                if(v > thresholdMinor) cls[x] = (v > thresholdMajor) ? 2 : 1;
+            }
+        }
+    });
+}
+
+// --------------------------------------------------------------------------
+const sf::Image& DoubleThreshold::apply(const sf::Image& image, float thresholdMajor, float thresholdMinor)
+{
+    classify(imageView(image), 255.0f, thresholdMajor, thresholdMinor, m_classes);
+    return output(image.getSize());
+}
+
+// --------------------------------------------------------------------------
+const ImageBuffer<sf::Uint8>& DoubleThreshold::apply(const ImageBuffer<float>& buffer, float thresholdMajor, float thresholdMinor)
+{
+    classify(buffer, 1.0f, thresholdMajor, thresholdMinor, m_classes);
+    return levels(buffer.size());
+}
+
+// --------------------------------------------------------------------------
+const ImageBuffer<sf::Uint8>& DoubleThreshold::levels(const sf::Vector2u& size)
+{
+    m_size = size;
+    if(m_mode == Edges) m_hysteresis.apply(m_classes, size);
+
+    // edges are 0/1, three values are 0/1/2
+    const sf::Uint8 values[2][3] = { {0, 128, 255}, {0, 255, 255} };
+    const sf::Uint8* level = values[m_mode==Edges ? 1 : 0];
+
+    m_buffer.create(size.x, size.y, 1);
+    parallelFor(0, size.y, [&](unsigned int y0, unsigned int y1)
+    {
+        for(unsigned int y=y0;y<y1;++y)
+        {
+            const sf::Uint8* cls = &m_classes[y*size.x];
+            sf::Uint8* dst = m_buffer.row(y);
+            for(unsigned int x=0;x<size.x;++x) dst[x] = level[cls[x]];
+        }
+    });
+
+    return m_buffer;
+}
+
+// --------------------------------------------------------------------------
+const sf::Image& DoubleThreshold::output(const sf::Vector2u& size)
+{
+    bufferToImage(levels(size), m_image);
+    return m_image;
+}
+
+// --------------------------------------------------------------------------
+const sf::Image& DoubleThreshold::applyAdaptive(const sf::Image& image, unsigned int radius, float offsetMajor, float offsetMinor)
+{
+    m_integral.compute(image, 0, 0, false);
+    return applyAdaptive(m_integral, image, radius, offsetMajor, offsetMinor);
+}
+
+// --------------------------------------------------------------------------
+const sf::Image& DoubleThreshold::applyAdaptive(const IntegralImage& table, const sf::Image& image, unsigned int radius, float offsetMajor, float offsetMinor)
+{
+    classifyAdaptive(table, imageView(image), sf::Vector2i(0,0), radius, offsetMajor, offsetMinor);
+    return output(image.getSize());
+}
+
+// --------------------------------------------------------------------------
+const sf::Image& DoubleThreshold::apply(const sf::Image& image, const sf::IntRect& roi, float thresholdMajor, float thresholdMinor)
+{
+    sf::IntRect region = roi;
+    sf::IntRect window = apronWindow(region, 0, image.getSize());
+
+    classify(imageView(image).view(window), 255.0f, thresholdMajor, thresholdMinor, m_classes);
+    return output(sf::Vector2u(window.width, window.height));
+}
+
+// --------------------------------------------------------------------------
+const sf::Image& DoubleThreshold::applyAdaptive(const sf::Image& image, const sf::IntRect& roi, unsigned int radius, float offsetMajor, float offsetMinor)
+{
+    sf::IntRect region = roi;
+    sf::IntRect window = apronWindow(region, radius, image.getSize());
+    const ImageBuffer<sf::Uint8> source = imageView(image).view(window);
+
+    // table of the window only, the region being at its offset
+    m_integral.compute(source, 0, 0, false);
+    classifyAdaptive(m_integral, source.view(region), sf::Vector2i(region.left, region.top), radius, offsetMajor, offsetMinor);
+    return output(sf::Vector2u(region.width, region.height));
+}
+
+// --------------------------------------------------------------------------
+void DoubleThreshold::classifyAdaptive(const IntegralImage& table, const ImageBuffer<sf::Uint8>& buffer, const sf::Vector2i& origin,
+                                       unsigned int radius, float offsetMajor, float offsetMinor)
+{
+    sf::Vector2u size = buffer.size();
+    unsigned int ch = buffer.channels();
+    m_classes.resize(size.x*size.y);
+    int r = radius;
+
+    parallelFor(0, size.y, [&](unsigned int y0, unsigned int y1)
+    {
+        for(int y=y0;y<(int)y1;++y)
+        {
+            const sf::Uint8* src = buffer.row(y);
+            for(int x=0;x<(int)size.x;++x)
+            {
+                unsigned int i = y*size.x+x;
+                float v = src[x*ch] / 255.0f;
+                int tx = origin.x+x, ty = origin.y+y;
+                float m = float(table.mean(tx-r, ty-r, tx+r, ty+r));
+
+                m_classes[i] = 0;
+                if(v > m+offsetMinor) m_classes[i] = (v > m+offsetMajor) ? 2 : 1;
+            }
+        }
+    });
+}
+
 // --------------------------------------------------------------------------
 const sf::Texture& DoubleThreshold::getResultAsTexture()
 {
+    if(m_mode == Edges) return m_edges;
     return m_target.getTexture();
 }
+
+// --------------------------------------------------------------------------
+const sf::Image& DoubleThreshold::getResultAsImage()
+{
+    return m_image;
+}
+
+// --------------------------------------------------------------------------
+const RunLengthMask& DoubleThreshold::getResultAsMask()
+{
+    m_mask.encode(m_classes, m_size);
+    return m_mask;
+}
@@ -3,31 +3,90 @@
 
 #include <SFML/Graphics.hpp>
 
+#include "hysteresis.hpp"
+#include "imageBuffer.hpp"
+#include "integralImage.hpp"
+#include "runLengthMask.hpp"
+
 // --------------------------------------------------------------------------
 // Helper class - give functions for thresholding texture
 class DoubleThreshold
 {
 public:
+
+    enum OutputMode
+    {
+        ThreeValues,    // 0, 0.5 (weak) and 1 (strong)
+        Edges           // hysteresis : strong pixels and weak ones connected to them, binary
+    };
+
     DoubleThreshold();
     virtual ~DoubleThreshold();
 
     void initialize();
     void cleanup();
 
+    void setOutputMode(OutputMode mode);
+
     // compute a 3-values texture from a input and two thresholds
     const sf::Texture& apply( const sf::Texture& texture, float thresholdMajor = 0.5, float thresholdMinor = 0.1 );
 
+    // CPU path, doesn't need any GL context
+    const sf::Image& apply( const sf::Image& image, float thresholdMajor = 0.5, float thresholdMinor = 0.1 );
+
+    // same on the first channel of a float buffer (values in [0,1]), single channel result
+    const ImageBuffer<sf::Uint8>& apply( const ImageBuffer<float>& buffer, float thresholdMajor = 0.5, float thresholdMinor = 0.1 );
+
+    // adaptive mode (CPU) : thresholds are offsets above the mean
+    // of a (2*radius+1)^2 window around each pixel
+    const sf::Image& applyAdaptive( const sf::Image& image, unsigned int radius, float offsetMajor = 0.1, float offsetMinor = 0.02 );
+
+    // adaptive mode reusing a table already computed on the red channel of the image
+    const sf::Image& applyAdaptive( const IntegralImage& table, const sf::Image& image, unsigned int radius, float offsetMajor = 0.1, float offsetMinor = 0.02 );
+
+    // CPU paths on a region of interest, result of the region size (clipped to the image).
+    // The adaptive means read the radius around the region, edges are tracked within it
+    const sf::Image& apply( const sf::Image& image, const sf::IntRect& roi, float thresholdMajor = 0.5, float thresholdMinor = 0.1 );
+    const sf::Image& applyAdaptive( const sf::Image& image, const sf::IntRect& roi, unsigned int radius, float offsetMajor = 0.1, float offsetMinor = 0.02 );
+
     // get result texture
     const sf::Texture& getResultAsTexture();
 
+    // get result image (CPU paths)
+    const sf::Image& getResultAsImage();
+
+    // get result as runs (CPU paths) : edges in Edges mode, weak and strong pixels otherwise
+    const RunLengthMask& getResultAsMask();
+
 protected:
 
     // resize render target
     void resizeRenderTarget(const sf::Vector2u& size);
 
+    // result buffer from m_classes, according to the output mode
+    const ImageBuffer<sf::Uint8>& levels(const sf::Vector2u& size);
+
+    // result image from m_classes, according to the output mode
+    const sf::Image& output(const sf::Vector2u& size);
+
+    // classes against the local means of a table, pixel (x,y) of the buffer being (x,y)+origin in it
+    void classifyAdaptive(const IntegralImage& table, const ImageBuffer<sf::Uint8>& buffer, const sf::Vector2i& origin,
+                          unsigned int radius, float offsetMajor, float offsetMinor);
+
     sf::RenderTexture m_target;         // target renderTexture
     sf::VertexBuffer m_vertexBuffer;    // target area
     sf::Shader m_2thresholdShader;        // shader for thresholding
+
+    OutputMode m_mode;
+    std::vector<sf::Uint8> m_classes;   // 0 none, 1 weak, 2 strong (CPU paths)
+    Hysteresis m_hysteresis;            // edge tracking
+    sf::Texture m_edges;                // GPU path result in Edges mode
+
+    IntegralImage m_integral;           // local means of the adaptive mode
+    sf::Image m_image;                  // CPU paths result
+    ImageBuffer<sf::Uint8> m_buffer;    // CPU paths result, single channel
+    sf::Vector2u m_size;                // CPU paths result size
+    RunLengthMask m_mask;               // CPU paths result as runs
 };
 
 #endif // BINARIZATION_HPP
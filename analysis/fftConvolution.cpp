@@ -0,0 +1,191 @@
+#include "fftConvolution.hpp"
+
+#include "cpuBackend.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// --------------------------------------------------------------------------
+static unsigned int nextPowerOfTwo(unsigned int n)
+{
+    unsigned int p = 1;
+    while(p < n) p <<= 1;
+    return p;
+}
+
+// --------------------------------------------------------------------------
+// in-place iterative radix-2 transform
+static void fft(std::complex<float>* a, unsigned int n, const std::vector<unsigned int>& bitrev,
+                const std::vector<std::complex<float>>& twiddles, bool inverse)
+{
+    for(unsigned int i=0;i<n;++i)
+    {
+        unsigned int j = bitrev[i];
+        if(i < j) std::swap(a[i], a[j]);
+    }
+
+    float sign = inverse ? -1.0f : 1.0f;
+    for(unsigned int len=2;len<=n;len<<=1)
+    {
+        unsigned int half = len/2;
+        unsigned int step = n/len;
+        for(unsigned int i=0;i<n;i+=len) for(unsigned int k=0;k<half;++k)
+        {
+            // complex product written out (std::complex one handles inf/nan and is slow)
+            float wr = twiddles[k*step].real();
+            float wi = twiddles[k*step].imag() * sign;
+            std::complex<float>& u = a[i+k];
+            std::complex<float>& v = a[i+k+half];
+            float vr = v.real()*wr - v.imag()*wi;
+            float vi = v.real()*wi + v.imag()*wr;
+            v = std::complex<float>(u.real()-vr, u.imag()-vi);
+            u = std::complex<float>(u.real()+vr, u.imag()+vi);
+        }
+    }
+}
+
+// --------------------------------------------------------------------------
+FFTConvolution::FFTConvolution()
+{
+    for(auto& s : _spectrumSize) s = 0;
+}
+
+// --------------------------------------------------------------------------
+FFTConvolution::~FFTConvolution()
+{
+}
+
+// --------------------------------------------------------------------------
+const FFTConvolution::Plan& FFTConvolution::plan(unsigned int n)
+{
+    auto it = _plans.find(n);
+    if(it != _plans.end()) return it->second;
+
+    Plan& p = _plans[n];
+
+    unsigned int bits = 0;
+    while((1u<<bits) < n) bits++;
+
+    p.bitrev.resize(n);
+    for(unsigned int i=0;i<n;++i)
+    {
+        unsigned int r = 0;
+        for(unsigned int b=0;b<bits;++b) if(i & (1u<<b)) r |= 1u << (bits-1-b);
+        p.bitrev[i] = r;
+    }
+
+    const double pi = 3.14159265358979323846;
+    p.twiddles.resize(std::max(1u, n/2));
+    for(unsigned int k=0;k<n/2;++k)
+    {
+        double a = -2.0*pi*k / n;
+        p.twiddles[k] = Complex(float(std::cos(a)), float(std::sin(a)));
+    }
+
+    return p;
+}
+
+// --------------------------------------------------------------------------
+void FFTConvolution::transform(Complex* data, unsigned int w, unsigned int h, bool inverse)
+{
+    const Plan& pw = plan(w);
+    const Plan& ph = plan(h);
+
+    parallelFor(0, h, [&](unsigned int y0, unsigned int y1)
+    {
+        for(unsigned int y=y0;y<y1;++y) fft(data + y*w, w, pw.bitrev, pw.twiddles, inverse);
+    });
+
+    parallelFor(0, w, [&](unsigned int x0, unsigned int x1)
+    {
+        std::vector<Complex> column(h);
+        for(unsigned int x=x0;x<x1;++x)
+        {
+            for(unsigned int y=0;y<h;++y) column[y] = data[y*w+x];
+            fft(column.data(), h, ph.bitrev, ph.twiddles, inverse);
+            for(unsigned int y=0;y<h;++y) data[y*w+x] = column[y];
+        }
+    });
+}
+
+// --------------------------------------------------------------------------
+void FFTConvolution::apply(const float* src, float* dst, unsigned int width, unsigned int height,
+                           const float* coefs, unsigned int kernelWidth, unsigned int kernelHeight)
+{
+    int rx = kernelWidth/2, ry = kernelHeight/2;
+
+    // the edge-replicated source needs kernel-1 extra samples, no wrap-around in the output area then
+    unsigned int pw = width + kernelWidth - 1;
+    unsigned int ph = height + kernelHeight - 1;
+    unsigned int w = nextPowerOfTwo(pw);
+    unsigned int h = nextPowerOfTwo(ph);
+    unsigned int n = w*h;
+
+    // kernel spectrum, conjugated for a correlation and scaled for the inverse transform
+    std::vector<float> kernel(coefs, coefs + kernelWidth*kernelHeight);
+    if(_spectrumSize[0]!=w || _spectrumSize[1]!=h || _spectrumSize[2]!=kernelWidth || _spectrumSize[3]!=kernelHeight
+       || _spectrumKernel != kernel)
+    {
+        _spectrum.assign(n, Complex(0.0f,0.0f));
+        for(unsigned int i=0;i<kernelWidth;++i) for(unsigned int j=0;j<kernelHeight;++j)
+            _spectrum[j*w+i] = Complex(kernel[i*kernelHeight+j], 0.0f);
+
+        transform(_spectrum.data(), w, h, false);
+
+        float scale = 1.0f / float(n);
+        for(auto& c : _spectrum) c = std::conj(c) * scale;
+
+        _spectrumKernel = kernel;
+        _spectrumSize[0] = w; _spectrumSize[1] = h;
+        _spectrumSize[2] = kernelWidth; _spectrumSize[3] = kernelHeight;
+    }
+
+    // two real channels share a complex transform (the kernel is real)
+    _rg.assign(n, Complex(0.0f,0.0f));
+    _b.assign(n, Complex(0.0f,0.0f));
+
+    parallelFor(0, ph, [&](unsigned int y0, unsigned int y1)
+    {
+        for(unsigned int py=y0;py<y1;++py)
+        {
+            int sy = std::min(std::max(int(py)-ry, 0), int(height)-1);
+            for(unsigned int px=0;px<pw;++px)
+            {
+                int sx = std::min(std::max(int(px)-rx, 0), int(width)-1);
+                const float* s = src + (sy*width+sx)*4;
+                _rg[py*w+px] = Complex(s[0], s[1]);
+                _b[py*w+px] = Complex(s[2], 0.0f);
+            }
+        }
+    });
+
+    transform(_rg.data(), w, h, false);
+    transform(_b.data(), w, h, false);
+
+    parallelFor(0, h, [&](unsigned int y0, unsigned int y1)
+    {
+        for(unsigned int i=y0*w;i<y1*w;++i)
+        {
+            const Complex& k = _spectrum[i];
+            Complex& a = _rg[i];
+            Complex& b = _b[i];
+            a = Complex(a.real()*k.real() - a.imag()*k.imag(), a.real()*k.imag() + a.imag()*k.real());
+            b = Complex(b.real()*k.real() - b.imag()*k.imag(), b.real()*k.imag() + b.imag()*k.real());
+        }
+    });
+
+    transform(_rg.data(), w, h, true);
+    transform(_b.data(), w, h, true);
+
+    parallelFor(0, height, [&](unsigned int y0, unsigned int y1)
+    {
+        for(unsigned int y=y0;y<y1;++y) for(unsigned int x=0;x<width;++x)
+        {
+            float* d = dst + (y*width+x)*4;
+            d[0] = _rg[y*w+x].real();
+            d[1] = _rg[y*w+x].imag();
+            d[2] = _b[y*w+x].real();
+            d[3] = 1.0f;
+        }
+    });
+}
@@ -0,0 +1,44 @@
+#ifndef FFT_CONVOLUTION_HPP
+#define FFT_CONVOLUTION_HPP
+
+#include <complex>
+#include <map>
+#include <vector>
+
+// --------------------------------------------------------------------------
+// Helper class - convolution in the frequency domain for large kernels (CPU).
+// Transform plans are cached per size, the kernel spectrum per image size.
+class FFTConvolution
+{
+public:
+    FFTConvolution();
+    virtual ~FFTConvolution();
+
+    // same sampling as Filter::process on RGBA float buffers : dst(x,y) = sum coefs(i,j) * src(x+i-w/2, y+j-h/2),
+    // clamped to edge. coefs are x-major like Matrix (index i*kernelHeight+j)
+    void apply(const float* src, float* dst, unsigned int width, unsigned int height,
+               const float* coefs, unsigned int kernelWidth, unsigned int kernelHeight);
+
+protected:
+
+    struct Plan
+    {
+        std::vector<unsigned int> bitrev;
+        std::vector<std::complex<float>> twiddles;
+    };
+
+    typedef std::complex<float> Complex;
+
+    const Plan& plan(unsigned int n);
+    void transform(Complex* data, unsigned int w, unsigned int h, bool inverse);
+
+    std::map<unsigned int, Plan> _plans;        // cached per transform length
+
+    std::vector<Complex> _spectrum;             // conjugated kernel spectrum, normalized
+    std::vector<float> _spectrumKernel;         // kernel the spectrum was computed for
+    unsigned int _spectrumSize[4];              // transform size and kernel size of the spectrum
+
+    std::vector<Complex> _rg, _b;               // work buffers (red + i*green, blue)
+};
+
+#endif // FFT_CONVOLUTION_HPP
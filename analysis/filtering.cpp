@@ -1,6 +1,19 @@
 #include "filtering.hpp"
 
+#include "cpuBackend.hpp"
+
+#include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <cmath>
+#include <mutex>
+#include <random>
+
+#if defined(ANALYSIS_SIMD_AVX)
+    #include <immintrin.h>
+#elif defined(ANALYSIS_SIMD_SSE)
+    #include <emmintrin.h>
+#endif
 
 // --------------------------------------------------------------------------
 #define GLSL_CODE( src ) #src
@@ -81,6 +94,12 @@ float& Matrix::operator()(unsigned int x, unsigned int y)
     return _buf[x*_colsize+y];
 }
 
+//--------------------------------------------------------------
+float Matrix::operator()(unsigned int x, unsigned int y) const
+{
+    return _buf[x*_colsize+y];
+}
+
 //--------------------------------------------------------------
 void Matrix::operator*=(float s)
 {
@@ -93,15 +112,237 @@ bool Matrix::valid() const
     return _rowsize>0 && _colsize>0;
 }
 
+//--------------------------------------------------------------
+Matrix Matrix::transposed() const
+{
+    Matrix res(_colsize,_rowsize);
+    for(unsigned int x=0;x<_rowsize;++x) for(unsigned int y=0;y<_colsize;++y) res(y,x) = (*this)(x,y);
+    return res;
+}
+
+//--------------------------------------------------------------
+std::vector<Matrix::SeparableTerm> Matrix::separate(unsigned int maxRank, float tolerance) const
+{
+    std::vector<SeparableTerm> terms;
+    if(!valid()) return terms;
+
+    unsigned int m = _rowsize, n = _colsize;
+
+    // one-sided Jacobi SVD : rotate the columns of A until they are orthogonal,
+    // then A*V = U*S, so column j of A*V is the horizontal kernel and column j of V the vertical one
+    std::vector<double> a(_buf.begin(), _buf.end());
+    std::vector<double> v(n*n, 0.0);
+    for(unsigned int j=0;j<n;++j) v[j*n+j] = 1.0;
+
+    for(int sweep=0;sweep<64;++sweep)
+    {
+        bool rotated = false;
+        for(unsigned int p=0;p<n;++p) for(unsigned int q=p+1;q<n;++q)
+        {
+            double alpha = 0.0, beta = 0.0, gamma = 0.0;
+            for(unsigned int i=0;i<m;++i)
+            {
+                alpha += a[i*n+p]*a[i*n+p];
+                beta += a[i*n+q]*a[i*n+q];
+                gamma += a[i*n+p]*a[i*n+q];
+            }
+            if(std::abs(gamma) <= 1e-15 * std::sqrt(alpha*beta)) continue;
+            rotated = true;
+
+            double zeta = (beta-alpha) / (2.0*gamma);
+            double t = (zeta>=0.0 ? 1.0 : -1.0) / (std::abs(zeta) + std::sqrt(1.0+zeta*zeta));
+            double c = 1.0 / std::sqrt(1.0+t*t);
+            double sn = c*t;
+
+            for(unsigned int i=0;i<m;++i)
+            {
+                double ap = a[i*n+p], aq = a[i*n+q];
+                a[i*n+p] = c*ap - sn*aq;
+                a[i*n+q] = sn*ap + c*aq;
+            }
+            for(unsigned int i=0;i<n;++i)
+            {
+                double vp = v[i*n+p], vq = v[i*n+q];
+                v[i*n+p] = c*vp - sn*vq;
+                v[i*n+q] = sn*vp + c*vq;
+            }
+        }
+        if(!rotated) break;
+    }
+
+    // singular values are the column norms, strongest terms first
+    std::vector<double> sigma(n, 0.0);
+    std::vector<unsigned int> order(n);
+    for(unsigned int j=0;j<n;++j)
+    {
+        for(unsigned int i=0;i<m;++i) sigma[j] += a[i*n+j]*a[i*n+j];
+        order[j] = j;
+    }
+    std::sort(order.begin(), order.end(), [&](unsigned int i, unsigned int j){return sigma[i]>sigma[j];});
+
+    std::vector<double> residual(_buf.begin(), _buf.end());
+    for(unsigned int r=0;r<std::min(maxRank,n);++r)
+    {
+        unsigned int j = order[r];
+
+        std::vector<double> h(m), w(n);
+        double sum = 0.0;
+        for(unsigned int i=0;i<m;++i) { h[i] = a[i*n+j]; sum += h[i]; }
+        for(unsigned int i=0;i<n;++i) w[i] = v[i*n+j];
+
+        // the horizontal kernel sums to 1 when possible (keeps the intermediate pass in range)
+        double scale = std::abs(sum) > 1e-12 ? sum : 1.0;
+
+        Matrix horizontal(m,1), vertical(1,n);
+        for(unsigned int i=0;i<m;++i) horizontal(i,0) = float(h[i]/scale);
+        for(unsigned int i=0;i<n;++i) vertical(0,i) = float(w[i]*scale);
+        terms.push_back( SeparableTerm(horizontal,vertical) );
+
+        double err = 0.0;
+        for(unsigned int x=0;x<m;++x) for(unsigned int y=0;y<n;++y)
+        {
+            residual[x*n+y] -= double(horizontal(x,0)) * double(vertical(0,y));
+            err += std::abs(residual[x*n+y]);
+        }
+        if(err <= tolerance) return terms;
+    }
+
+    terms.clear();
+    return terms;
+}
+
+
+//--------------------------------------------------------------
+// CPU convolution, sampling like s_glsl_filter : the u_matrixsize*0.5 offset
+// on a pixel center with nearest texel gives src(x + i - w/2, y + j - h/2),
+// clamped to edge
+static void convolve(const float* src, float* dst, unsigned int width, unsigned int height, const Matrix& mat)
+{
+    int mw = mat.rowSize();
+    int mh = mat.colSize();
+    int rx = mw/2, ry = mh/2;
+
+    // edge-replicated copy of the source, every output pixel is then an interior one
+    unsigned int pw = width + mw - 1;
+    unsigned int ph = height + mh - 1;
+    std::vector<float> padded(pw*ph*4);
+
+    parallelFor(0, ph, [&](unsigned int y0, unsigned int y1)
+    {
+        for(unsigned int py=y0;py<y1;++py)
+        {
+            int sy = std::min(std::max(int(py)-ry, 0), int(height)-1);
+            const float* srow = src + sy*width*4;
+            float* prow = &padded[py*pw*4];
+            for(unsigned int px=0;px<pw;++px)
+            {
+                int sx = std::min(std::max(int(px)-rx, 0), int(width)-1);
+                for(int c=0;c<4;++c) prow[px*4+c] = srow[sx*4+c];
+            }
+        }
+    });
+
+    // non-zero taps, as offsets in the padded buffer
+    std::vector<unsigned int> offsets;
+    std::vector<float> coefs;
+    for(int j=0;j<mh;++j) for(int i=0;i<mw;++i)
+    {
+        float c = mat(i,j);
+        if(c == 0.0f) continue;
+        offsets.push_back((j*pw + i)*4);
+        coefs.push_back(c);
+    }
+    unsigned int ntaps = coefs.size();
+
+    parallelFor(0, height, [&](unsigned int y0, unsigned int y1)
+    {
+        for(unsigned int y=y0;y<y1;++y)
+        {
+            const float* prow = &padded[y*pw*4];
+            float* drow = dst + y*width*4;
+            unsigned int x = 0;
+
+#if defined(ANALYSIS_SIMD_AVX)
+            // two RGBA pixels per register
+            for(;x+2<=width;x+=2)
+            {
+                __m256 acc = _mm256_setzero_ps();
+                for(unsigned int t=0;t<ntaps;++t)
+                {
+                    __m256 v = _mm256_loadu_ps(prow + x*4 + offsets[t]);
+                    acc = _mm256_add_ps(acc, _mm256_mul_ps(v, _mm256_set1_ps(coefs[t])));
+                }
+                _mm256_storeu_ps(drow + x*4, acc);
+            }
+#endif
+
+#if defined(ANALYSIS_SIMD_SSE)
+            // one RGBA pixel per register
+            for(;x<width;++x)
+            {
+                __m128 acc = _mm_setzero_ps();
+                for(unsigned int t=0;t<ntaps;++t)
+                {
+                    __m128 v = _mm_loadu_ps(prow + x*4 + offsets[t]);
+                    acc = _mm_add_ps(acc, _mm_mul_ps(v, _mm_set1_ps(coefs[t])));
+                }
+                _mm_storeu_ps(drow + x*4, acc);
+            }
+#else
+            for(;x<width;++x)
+            {
+                float acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+                for(unsigned int t=0;t<ntaps;++t)
+                {
+                    const float* v = prow + x*4 + offsets[t];
+                    for(int c=0;c<4;++c) acc[c] += v[c] * coefs[t];
+                }
+                for(int c=0;c<4;++c) drow[x*4+c] = acc[c];
+            }
+#endif
+
+            // shader writes an opaque color
+            for(x=0;x<width;++x) drow[x*4+3] = 1.0f;
+        }
+    });
+}
+
+//--------------------------------------------------------------
+// residual allowed for separable kernels : outputs stay within half a 8-bit level
+static const float s_separableTolerance = 0.5f / 255.0f;
+
+//--------------------------------------------------------------
+static bool isNonNegative(const Matrix& mat)
+{
+    for(unsigned int i=0;i<mat.rowSize()*mat.colSize();++i) if(mat.data()[i] < 0.0f) return false;
+    return true;
+}
+
+//--------------------------------------------------------------
+// size of the u_matrix uniform arrays
+static const unsigned int s_maxShaderTaps = 81;
+
+//--------------------------------------------------------------
+Filter::Backend Filter::s_defaultBackend = Filter::GPU;
+std::atomic<unsigned int> Filter::s_fftCrossover(0);
+
+// the benchmark runs once, whatever the threads asking for the crossover
+static std::once_flag s_fftCalibration;
 
 //--------------------------------------------------------------
 Filter::Filter()
+    : _separable(true)
+    , _taps(0)
+    , _backend(s_defaultBackend)
 {
     initialize();
 }
 
 //--------------------------------------------------------------
 Filter::Filter(const Matrix& mat)
+    : _separable(true)
+    , _taps(0)
+    , _backend(s_defaultBackend)
 {
     initialize();
     setMatrix(mat);
@@ -116,6 +357,8 @@ Filter::~Filter()
 //--------------------------------------------------------------
 void Filter::initialize()
 {
+    if(_backend != GPU) return;
+
     _area = sf::VertexBuffer(sf::Quads, sf::VertexBuffer::Static);
     _area.create(4);
 
@@ -134,16 +377,181 @@ void Filter::cleanup()
 void Filter::setMatrix(const Matrix& mat)
 {
     _matrix = mat;
+    updateKernel();
+}
+
+//--------------------------------------------------------------
+void Filter::setSeparable(bool enabled)
+{
+    _separable = enabled;
+    updateKernel();
+}
+
+//--------------------------------------------------------------
+void Filter::updateKernel()
+{
+    _terms.clear();
+    _taps = 0;
+    for(unsigned int i=0;i<_matrix.size();++i) if(_matrix.data()[i] != 0.0f) _taps++;
+
+    if(!_separable || !_matrix.valid()) return;
+
+    unsigned int mw = _matrix.rowSize();
+    unsigned int mh = _matrix.colSize();
+
+    // only worth it when the passes read fewer samples than the full kernel
+    std::vector<Matrix::SeparableTerm> terms = _matrix.separate(std::min(mw,mh), s_separableTolerance);
+    if(!terms.empty() && terms.size()*(mw+mh) < _taps) _terms = terms;
+}
+
+//--------------------------------------------------------------
+void Filter::setSeparableMatrix(const Matrix& horizontal, const Matrix& vertical)
+{
+    unsigned int mw = horizontal.rowSize();
+    unsigned int mh = vertical.colSize();
+
+    _matrix = Matrix(mw,mh);
+    for(unsigned int x=0;x<mw;++x) for(unsigned int y=0;y<mh;++y) _matrix(x,y) = horizontal(x,0) * vertical(0,y);
+
+    _terms.clear();
+    _taps = 0;
+    for(unsigned int i=0;i<_matrix.size();++i) if(_matrix.data()[i] != 0.0f) _taps++;
+
+    if(_separable && mw+mh < _taps) _terms.push_back( Matrix::SeparableTerm(horizontal,vertical) );
+}
+
+//--------------------------------------------------------------
+unsigned int Filter::fftCrossover()
+{
+    std::call_once(s_fftCalibration, []
+    {
+        if(s_fftCrossover == 0) s_fftCrossover = calibrateFFTCrossover();
+    });
+    return s_fftCrossover;
+}
+
+//--------------------------------------------------------------
+void Filter::setFFTCrossover(unsigned int taps)
+{
+    s_fftCrossover = taps;
+}
+
+//--------------------------------------------------------------
+unsigned int Filter::calibrateFFTCrossover()
+{
+    typedef std::chrono::steady_clock Clock;
+
+    const unsigned int w = 200, h = 200;
+    std::vector<float> src(w*h*4), dst(w*h*4);
+    std::minstd_rand rng(1);
+    for(auto& v : src) v = (rng() % 256) / 255.0f;
+
+    FFTConvolution fft;
+
+    // best of two runs, the second FFT one reuses the cached kernel spectrum like consecutive frames do
+    auto best = [](const std::function<void()>& run)
+    {
+        double t = 1e30;
+        for(int i=0;i<2;++i)
+        {
+            Clock::time_point start = Clock::now();
+            run();
+            t = std::min(t, std::chrono::duration<double>(Clock::now()-start).count());
+        }
+        return t;
+    };
+
+    unsigned int k = 3;
+    for(;k<=31;k+=2)
+    {
+        // dense non-separable kernel
+        Matrix mat(k,k);
+        for(unsigned int i=0;i<k*k;++i) mat(i/k,i%k) = (rng() % 1000) / 1000.0f / (k*k);
+
+        double direct = best([&]{ convolve(src.data(), dst.data(), w, h, mat); });
+        double freq = best([&]{ fft.apply(src.data(), dst.data(), w, h, mat.data(), k, k); });
+        if(freq < direct) return k*k;
+    }
+
+    return k*k;
+}
+
+//--------------------------------------------------------------
+void Filter::setDefaultBackend(Backend backend)
+{
+    s_defaultBackend = backend;
+
+    // calibrated now rather than on the first apply()
+    if(backend == CPU) fftCrossover();
+}
+
+//--------------------------------------------------------------
+Filter::Backend Filter::defaultBackend()
+{
+    return s_defaultBackend;
+}
+
+//--------------------------------------------------------------
+void Filter::setBackend(Backend backend)
+{
+    bool reload = (backend == GPU && _backend != GPU);
+    _backend = backend;
+
+    // GL resources are only created for the GPU backend
+    if(reload) initialize();
 }
 
 //--------------------------------------------------------------
 const sf::Texture& Filter::apply(const sf::Texture& src)
 {
+    if(_backend == CPU)
+    {
+        _cpuTexture.loadFromImage( apply(src.copyToImage()) );
+        return _cpuTexture;
+    }
+
     if(_target.getSize() != src.getSize()) resize(src.getSize());
 
-    if(_matrix.valid())
+    sf::Vector2f srcsize(src.getSize().x, src.getSize().y);
+
+    // render targets are 8-bit : the intermediate pass needs a non-negative rank-1 kernel
+    bool separable = _terms.size()==1 && isNonNegative(_terms[0].first) && isNonNegative(_terms[0].second)
+                  && _matrix.rowSize() <= s_maxShaderTaps && _matrix.colSize() <= s_maxShaderTaps;
+
+    if(!separable && _matrix.size() > s_maxShaderTaps)
+    {
+        // too large for the shader : CPU result copied into the target with an identity kernel
+        _cpuTexture.loadFromImage( apply(src.copyToImage()) );
+
+        Matrix identity(1,1);
+        identity(0,0) = 1.0;
+
+        _shader.setUniform("u_src", _cpuTexture);
+        _shader.setUniform("u_srcsize", srcsize);
+        _shader.setUniformArray("u_matrix", identity.data(), identity.size());
+        _shader.setUniform("u_matrixsize", sf::Vector2f(1,1));
+        _target.draw(_area, &_shader);
+    }
+    else if(separable)
+    {
+        if(_subtarget.getSize() != src.getSize()) _subtarget.create(src.getSize().x, src.getSize().y);
+
+        Matrix& horizontal = _terms[0].first;
+        Matrix& vertical = _terms[0].second;
+
+        _shader.setUniform("u_src", src);
+        _shader.setUniform("u_srcsize", srcsize);
+        _shader.setUniformArray("u_matrix", horizontal.data(), horizontal.size());
+        _shader.setUniform("u_matrixsize", sf::Vector2f(horizontal.rowSize(),1));
+        _subtarget.draw(_area, &_shader);
+
+        _shader.setUniform("u_src", _subtarget.getTexture());
+        _shader.setUniformArray("u_matrix", vertical.data(), vertical.size());
+        _shader.setUniform("u_matrixsize", sf::Vector2f(1,vertical.colSize()));
+        _target.draw(_area, &_shader);
+    }
+    else if(_matrix.valid())
     {
-        sf::Vector2f srcsize(src.getSize().x, src.getSize().y);
         sf::Vector2f matsize(_matrix.rowSize(),_matrix.colSize());
 
         _shader.setUniform("u_src", src);
@@ -157,12 +565,114 @@ const sf::Texture& Filter::apply(const sf::Texture& src)
     return texture();
 }
 
+//--------------------------------------------------------------
+const sf::Image& Filter::apply(const sf::Image& src)
+{
+    if(_matrix.valid())
+    {
+        imageToBuffer(src, _srcBuffer);
+        _dstBuffer.resize(_srcBuffer.size());
+
+        process(_srcBuffer.data(), _dstBuffer.data(), src.getSize().x, src.getSize().y);
+
+        bufferToImage(_dstBuffer, src.getSize(), _cpuImage);
+    }
+
+    return image();
+}
+
+//--------------------------------------------------------------
+const ImageBuffer<float>& Filter::apply(const ImageBuffer<float>& src)
+{
+    if(_matrix.valid())
+    {
+        bufferToRGBA(src, _srcBuffer);
+        _dstBuffer.resize(_srcBuffer.size());
+
+        process(_srcBuffer.data(), _dstBuffer.data(), src.width(), src.height());
+
+        _cpuResult.create(src.width(), src.height(), src.channels());
+        rgbaToBuffer(_dstBuffer, _cpuResult);
+    }
+
+    return _cpuResult;
+}
+
+//--------------------------------------------------------------
+const sf::Image& Filter::apply(const sf::Image& src, const sf::IntRect& roi)
+{
+    if(_matrix.valid())
+    {
+        sf::IntRect region = roi;
+        sf::IntRect window = apronWindow(region, apron(), src.getSize());
+
+        imageToBuffer(src, window, _srcBuffer);
+        _dstBuffer.resize(_srcBuffer.size());
+
+        if(!_srcBuffer.empty()) process(_srcBuffer.data(), _dstBuffer.data(), window.width, window.height);
+
+        bufferToImage(_dstBuffer, sf::Vector2u(window.width, window.height), region, _cpuImage);
+    }
+
+    return image();
+}
+
+//--------------------------------------------------------------
+unsigned int Filter::apron() const
+{
+    return std::max(_matrix.rowSize(), _matrix.colSize()) / 2;
+}
+
+//--------------------------------------------------------------
+void Filter::process(const float* src, float* dst, unsigned int width, unsigned int height)
+{
+    if(_terms.empty())
+    {
+        if(_taps >= fftCrossover())
+            _fft.apply(src, dst, width, height, _matrix.data(), _matrix.rowSize(), _matrix.colSize());
+        else
+            convolve(src, dst, width, height, _matrix);
+        return;
+    }
+
+    unsigned int n = width*height*4;
+    _tmpBuffer.resize(n);
+
+    std::vector<float> part;
+    for(unsigned int t=0;t<_terms.size();++t)
+    {
+        convolve(src, _tmpBuffer.data(), width, height, _terms[t].first);
+        if(t==0)
+        {
+            convolve(_tmpBuffer.data(), dst, width, height, _terms[t].second);
+            continue;
+        }
+
+        // low-rank kernel : accumulate the next terms
+        part.resize(n);
+        convolve(_tmpBuffer.data(), part.data(), width, height, _terms[t].second);
+        parallelFor(0, height, [&](unsigned int y0, unsigned int y1)
+        {
+            for(unsigned int i=y0*width*4; i<y1*width*4; ++i) dst[i] += part[i];
+        });
+    }
+
+    for(unsigned int i=3;i<n;i+=4) dst[i] = 1.0f;
+}
+
 //--------------------------------------------------------------
 const sf::Texture& Filter::texture() const
 {
+    if(_backend == CPU) return _cpuTexture;
     return _target.getTexture();
 }
 
+//--------------------------------------------------------------
+const sf::Image& Filter::image() const
+{
+    return _cpuImage;
+}
+
 //--------------------------------------------------------------
 void Filter::resize(const sf::Vector2u& size)
 {
@@ -250,6 +760,7 @@ SobelFilter::SobelFilter()
     kernel(0,1) =  2.0; kernel(1,1) =  0.0; kernel(2,1) = -2.0;
     kernel(0,2) =  1.0; kernel(1,2) =  0.0; kernel(2,2) = -1.0;
     setMatrix(kernel);
+    setSeparable(false); // gx/gy shader
 
     initialize();
 }
@@ -257,6 +768,8 @@ SobelFilter::SobelFilter()
 //--------------------------------------------------------------
 void SobelFilter::initialize()
 {
+    if(_backend != GPU) return;
+
     _area = sf::VertexBuffer(sf::Quads, sf::VertexBuffer::Static);
     _area.create(4);
 
@@ -272,6 +785,73 @@ void SobelFilter::cleanup()
 
 }
 
+//--------------------------------------------------------------
+void SobelFilter::updateKernel()
+{
+    Filter::updateKernel();
+
+    _termsX.clear();
+    _termsY.clear();
+    if(!_matrix.valid() || _matrix.rowSize() != _matrix.colSize()) return;
+
+    _termsX = _matrix.separate(1, s_separableTolerance);
+    _termsY = _matrix.transposed().separate(1, s_separableTolerance);
+}
+
+//--------------------------------------------------------------
+void SobelFilter::process(const float* src, float* dst, unsigned int width, unsigned int height)
+{
+    // rank-1 kernel : gx and gy through horizontal and vertical passes
+    const std::vector<Matrix::SeparableTerm>& tx = _termsX;
+    const std::vector<Matrix::SeparableTerm>& ty = _termsY;
+    if(!tx.empty() && !ty.empty())
+    {
+        unsigned int n = width*height*4;
+        std::vector<float> gx(n), gy(n);
+        _tmpBuffer.resize(n);
+
+        convolve(src, _tmpBuffer.data(), width, height, tx[0].first);
+        convolve(_tmpBuffer.data(), gx.data(), width, height, tx[0].second);
+        convolve(src, _tmpBuffer.data(), width, height, ty[0].first);
+        convolve(_tmpBuffer.data(), gy.data(), width, height, ty[0].second);
+
+        parallelFor(0, height, [&](unsigned int y0, unsigned int y1)
+        {
+            for(unsigned int i=y0*width*4; i<y1*width*4; i+=4)
+            {
+                float grad = std::min(std::sqrt(gx[i]*gx[i] + gy[i]*gy[i]), 1.0f);
+                dst[i] = grad; dst[i+1] = grad; dst[i+2] = grad; dst[i+3] = 1.0f;
+            }
+        });
+        return;
+    }
+
+    int mw = _matrix.rowSize();
+    int mh = _matrix.colSize();
+    int r = mw/2;   // shader offsets both axes by u_matrixsize.x*0.5
+
+    parallelFor(0, height, [&](unsigned int y0, unsigned int y1)
+    {
+        for(unsigned int y=y0;y<y1;++y) for(unsigned int x=0;x<width;++x)
+        {
+            float gx = 0.0f, gy = 0.0f;
+            for(int i=0;i<mw;++i) for(int j=0;j<mh;++j)
+            {
+                int sx = std::min(std::max(int(x)+i-r, 0), int(width)-1);
+                int sy = std::min(std::max(int(y)+j-r, 0), int(height)-1);
+                float v = src[(sy*width+sx)*4];
+                gx += v * _matrix(i,j);
+                gy += v * _matrix(j,i);
+            }
+
+            float grad = std::min(std::max(std::sqrt(gx*gx + gy*gy), 0.0f), 1.0f);
+
+            float* d = dst + (y*width+x)*4;
+            d[0] = grad; d[1] = grad; d[2] = grad; d[3] = 1.0f;
+        }
+    });
+}
+
 
 
 //--------------------------------------------------------------
@@ -287,6 +867,199 @@ BlurFilter::BlurFilter()
 }
 
 
+//--------------------------------------------------------------
+BoxFilter::BoxFilter(unsigned int radius)
+    : _radius(radius)
+{
+    unsigned int k = 2*radius+1;
+    Matrix horizontal(k,1), vertical(1,k);
+    for(unsigned int i=0;i<k;++i)
+    {
+        horizontal(i,0) = 1.0/float(k);
+        vertical(0,i) = 1.0/float(k);
+    }
+
+    setSeparableMatrix(horizontal, vertical);
+}
+
+//--------------------------------------------------------------
+void BoxFilter::process(const float* src, float* dst, unsigned int width, unsigned int height)
+{
+    int r = _radius;
+
+    // tables extended by the radius : edge-replicated windows like the shader
+    for(unsigned int c=0;c<3;++c) _tables[c].compute(src, width, height, c, _radius, false);
+
+    float norm = 1.0f / float((2*r+1)*(2*r+1));
+    parallelFor(0, height, [&](unsigned int y0, unsigned int y1)
+    {
+        for(int y=y0;y<(int)y1;++y) for(int x=0;x<(int)width;++x)
+        {
+            float* d = dst + (y*width+x)*4;
+            for(unsigned int c=0;c<3;++c) d[c] = float(_tables[c].sum(x-r, y-r, x+r, y+r)) * norm;
+            d[3] = 1.0f;
+        }
+    });
+}
+
+//--------------------------------------------------------------
+// below this sigma the Young - van Vliet approximation drifts by more than a level
+// from the sampled gaussian (4 levels at sigma 2)
+static const float s_recursiveSigma = 5.0f;
+
+//--------------------------------------------------------------
+GaussianFilter::GaussianFilter(float sigma)
+    : _sigma(std::max(sigma, 0.5f))
+{
+    // Young - van Vliet coefficients
+    float q = _sigma >= 2.5f ? 0.98711f*_sigma - 0.96330f
+                             : 3.97156f - 4.14554f*std::sqrt(1.0f - 0.26891f*_sigma);
+    float q2 = q*q, q3 = q2*q;
+    float b0 = 1.57825f + 2.44413f*q + 1.4281f*q2 + 0.422205f*q3;
+    _b[1] = (2.44413f*q + 2.85619f*q2 + 1.26661f*q3) / b0;
+    _b[2] = -(1.4281f*q2 + 1.26661f*q3) / b0;
+    _b[3] = 0.422205f*q3 / b0;
+    _b[0] = 1.0f - (_b[1] + _b[2] + _b[3]);
+
+    // Triggs - Sdika : anti-causal initial values equal to an infinite replicated edge
+    double a1 = _b[1], a2 = _b[2], a3 = _b[3];
+    double sm = 1.0 / ((1.0+a1-a2+a3) * (1.0-a1-a2-a3) * (1.0+a2+(a1-a3)*a3));
+    _m[0] = float(sm * (-a3*a1 + 1.0 - a3*a3 - a2));
+    _m[1] = float(sm * (a3+a1) * (a2+a3*a1));
+    _m[2] = float(sm * a3 * (a1+a3*a2));
+    _m[3] = float(sm * (a1+a3*a2));
+    _m[4] = float(-sm * (a2-1.0) * (a2+a3*a1));
+    _m[5] = float(-sm * a3 * (a3*a1 + a3*a3 + a2 - 1.0));
+    _m[6] = float(sm * (a3*a1 + a2 + a1*a1 - a2*a2));
+    _m[7] = float(sm * (a1*a2 + a3*a2*a2 - a1*a3*a3 - a3*a3*a3 - a3*a2 + a3));
+    _m[8] = float(sm * a3 * (a1+a3*a2));
+
+    // sampled kernel for the shader passes
+    int r = int(std::ceil(3.0f*_sigma));
+    Matrix horizontal(2*r+1,1), vertical(1,2*r+1);
+    float sum = 0.0f;
+    for(int i=-r;i<=r;++i) sum += std::exp(-0.5f*i*i/(_sigma*_sigma));
+    for(int i=-r;i<=r;++i)
+    {
+        float g = std::exp(-0.5f*i*i/(_sigma*_sigma)) / sum;
+        horizontal(i+r,0) = g;
+        vertical(0,i+r) = g;
+    }
+
+    setSeparableMatrix(horizontal, vertical);
+}
+
+//--------------------------------------------------------------
+unsigned int GaussianFilter::apron() const
+{
+    if(_sigma < s_recursiveSigma) return Filter::apron();
+    return (unsigned int)std::ceil(4.0f*_sigma);
+}
+
+//--------------------------------------------------------------
+void GaussianFilter::process(const float* src, float* dst, unsigned int width, unsigned int height)
+{
+    // small sigma : the recursive filter is off by several levels, sampled kernel as on GPU
+    if(_sigma < s_recursiveSigma)
+    {
+        Filter::process(src, dst, width, height);
+        return;
+    }
+
+    if(width==0 || height==0) return;
+
+    const float b0 = _b[0], b1 = _b[1], b2 = _b[2], b3 = _b[3];
+    const float* m = _m;
+
+    // anti-causal start from the last causal outputs w0,w1,w2 and the edge value e
+    auto start = [=](float w0, float w1, float w2, float e, float& p1, float& p2, float& p3)
+    {
+        float d0 = w0-e, d1 = w1-e, d2 = w2-e;
+        p1 = e + b0*(m[0]*d0 + m[1]*d1 + m[2]*d2);
+        p2 = e + b0*(m[3]*d0 + m[4]*d1 + m[5]*d2);
+        p3 = e + b0*(m[6]*d0 + m[7]*d1 + m[8]*d2);
+    };
+
+    // causal then anti-causal recursion along each row, edges replicated
+    parallelFor(0, height, [&](unsigned int y0, unsigned int y1)
+    {
+        std::vector<float> w(width*4);
+        unsigned int l1 = width>1 ? width-2 : 0;
+        unsigned int l2 = width>2 ? width-3 : l1;
+
+        for(unsigned int y=y0;y<y1;++y)
+        {
+            const float* s = src + y*width*4;
+            float* d = dst + y*width*4;
+            for(unsigned int c=0;c<4;++c)
+            {
+                float w1 = s[c], w2 = s[c], w3 = s[c];
+                for(unsigned int x=0;x<width;++x)
+                {
+                    float v = b0*s[x*4+c] + b1*w1 + b2*w2 + b3*w3;
+                    w3 = w2; w2 = w1; w1 = v;
+                    w[x*4+c] = v;
+                }
+
+                float p1, p2, p3;
+                start(w[(width-1)*4+c], w[l1*4+c], w[l2*4+c], s[(width-1)*4+c], p1, p2, p3);
+                d[(width-1)*4+c] = p1;
+                for(int x=width-2;x>=0;--x)
+                {
+                    float v = b0*w[x*4+c] + b1*p1 + b2*p2 + b3*p3;
+                    p3 = p2; p2 = p1; p1 = v;
+                    d[x*4+c] = v;
+                }
+            }
+        }
+    });
+
+    // columns in place, each worker walks whole rows of its range of columns
+    parallelFor(0, width, [&](unsigned int x0, unsigned int x1)
+    {
+        unsigned int n = (x1-x0)*4;
+        unsigned int l1 = height>1 ? height-2 : 0;
+        unsigned int l2 = height>2 ? height-3 : l1;
+
+        std::vector<float> h1(dst + x0*4, dst + x1*4), h2(h1), h3(h1);
+        const float* last = dst + ((height-1)*width+x0)*4;
+        std::vector<float> edge(last, last+n);
+
+        for(unsigned int y=0;y<height;++y)
+        {
+            float* d = dst + (y*width+x0)*4;
+            for(unsigned int i=0;i<n;++i)
+            {
+                float v = b0*d[i] + b1*h1[i] + b2*h2[i] + b3*h3[i];
+                h3[i] = h2[i]; h2[i] = h1[i]; h1[i] = v;
+                d[i] = v;
+            }
+        }
+
+        float* d0 = dst + ((height-1)*width+x0)*4;
+        const float* d1 = dst + (l1*width+x0)*4;
+        const float* d2 = dst + (l2*width+x0)*4;
+        for(unsigned int i=0;i<n;++i)
+        {
+            start(d0[i], d1[i], d2[i], edge[i], h1[i], h2[i], h3[i]);
+            d0[i] = h1[i];
+        }
+
+        for(int y=height-2;y>=0;--y)
+        {
+            float* d = dst + (y*width+x0)*4;
+            for(unsigned int i=0;i<n;++i)
+            {
+                float v = b0*d[i] + b1*h1[i] + b2*h2[i] + b3*h3[i];
+                h3[i] = h2[i]; h2[i] = h1[i]; h1[i] = v;
+                d[i] = v;
+            }
+        }
+    });
+
+    for(unsigned int i=3;i<width*height*4;i+=4) dst[i] = 1.0f;
+}
+
 //--------------------------------------------------------------
 SharpFilter::SharpFilter()
 {
@@ -420,6 +1193,7 @@ GradientsMap::GradientsMap()
     Matrix kernel(3,1);
     kernel(0,0) = -1.0; kernel(1,0) =  0.0; kernel(2,0) =  1.0;
     setMatrix(kernel);
+    setSeparable(false); // gradients shader
 
     initialize();
 }
@@ -427,6 +1201,8 @@ GradientsMap::GradientsMap()
 //--------------------------------------------------------------
 void GradientsMap::initialize()
 {
+    if(_backend != GPU) return;
+
     _area = sf::VertexBuffer(sf::Quads, sf::VertexBuffer::Static);
     _area.create(4);
 
@@ -441,6 +1217,41 @@ void GradientsMap::cleanup()
 {
 }
 
+//--------------------------------------------------------------
+void GradientsMap::process(const float* src, float* dst, unsigned int width, unsigned int height)
+{
+    const float pi = 3.141592f;
+    const float* m = _matrix.data();
+
+    parallelFor(0, height, [&](unsigned int y0, unsigned int y1)
+    {
+        for(unsigned int y=y0;y<y1;++y) for(unsigned int x=0;x<width;++x)
+        {
+            float gx = 0.0f, gy = 0.0f;
+            for(int f=0;f<3;++f)
+            {
+                int sx = std::min(std::max(int(x)+f-1, 0), int(width)-1);
+                int sy = std::min(std::max(int(y)+f-1, 0), int(height)-1);
+                gx += src[(y*width+sx)*4] * m[f];
+                gy += src[(sy*width+x)*4] * m[f];
+            }
+
+            float grad = std::min(std::max(std::sqrt(gx*gx + gy*gy), 0.0f), 1.0f);
+            float ori = 0.0f;
+            if(gx==0.0f)
+                ori = gy>0.0f ? pi*0.5f : -pi*0.5f;
+            else
+                ori = std::atan2(gy,gx);
+
+            ori += pi;
+            ori /= (2.0f*pi);
+
+            float* d = dst + (y*width+x)*4;
+            d[0] = grad; d[1] = ori; d[2] = 0.0f; d[3] = 1.0f;
+        }
+    });
+}
+
 
 
 
@@ -503,6 +1314,7 @@ LocalMaximaFilter::LocalMaximaFilter()
 {
     Matrix kernel(3,3); // not used
     setMatrix(kernel);
+    setSeparable(false);
 
     initialize();
 }
@@ -510,6 +1322,8 @@ LocalMaximaFilter::LocalMaximaFilter()
 //--------------------------------------------------------------
 void LocalMaximaFilter::initialize()
 {
+    if(_backend != GPU) return;
+
     _area = sf::VertexBuffer(sf::Quads, sf::VertexBuffer::Static);
     _area.create(4);
 
@@ -523,3 +1337,38 @@ void LocalMaximaFilter::initialize()
 void LocalMaximaFilter::cleanup()
 {
 }
+
+//--------------------------------------------------------------
+void LocalMaximaFilter::process(const float* src, float* dst, unsigned int width, unsigned int height)
+{
+    const float pi = 3.141592f;
+
+    // nearest texel around a pixel center, clamped to edge. The offset is rounded
+    // on its own so the result doesn't depend on the position (regions of interest)
+    auto intensity = [&](unsigned int x, unsigned int y, float ox, float oy)
+    {
+        int sx = std::min(std::max(int(x) + int(std::floor(0.5f + ox)), 0), int(width)-1);
+        int sy = std::min(std::max(int(y) + int(std::floor(0.5f + oy)), 0), int(height)-1);
+        return src[(sy*width+sx)*4];
+    };
+
+    parallelFor(0, height, [&](unsigned int y0, unsigned int y1)
+    {
+        for(unsigned int y=y0;y<y1;++y) for(unsigned int x=0;x<width;++x)
+        {
+            const float* s = src + (y*width+x)*4;
+            float local_i = s[0];
+            float o = s[1] * (2.0f*pi) - pi;
+            float dx = std::cos(o), dy = std::sin(o);
+
+            float c_i1 = intensity(x, y, -dx, -dy);
+            float c_i2 = intensity(x, y, dx, dy);
+
+            if(c_i1 > local_i) local_i = 0.0f;
+            if(c_i2 > local_i) local_i = 0.0f;
+
+            float* d = dst + (y*width+x)*4;
+            d[0] = local_i; d[1] = local_i; d[2] = local_i; d[3] = 1.0f;
+        }
+    });
+}
@@ -3,6 +3,12 @@
 
 #include <SFML/Graphics.hpp>
 
+#include "fftConvolution.hpp"
+#include "imageBuffer.hpp"
+#include "integralImage.hpp"
+
+#include <atomic>
+
 //--------------------------------------------------------------
 // Define a matrix. Can be used by Filter or Morphology
 class Matrix
@@ -13,6 +19,7 @@ public:
     virtual ~Matrix();
 
     float& operator()(unsigned int x, unsigned int y);
+    float operator()(unsigned int x, unsigned int y) const;
     void operator*=(float s);
 
     bool valid() const;
@@ -23,6 +30,15 @@ public:
     unsigned int rowSize() const {return _rowsize;}
     unsigned int colSize() const {return _colsize;}
 
+    Matrix transposed() const;
+
+    // rank-1 term : horizontal (rowsize x 1) and vertical (1 x colsize) kernels
+    typedef std::pair<Matrix,Matrix> SeparableTerm;
+
+    // SVD decomposition in the fewest rank-1 terms whose sum stays within tolerance
+    // of the matrix (L1 norm of the residual). Empty if more than maxRank terms are needed
+    std::vector<SeparableTerm> separate(unsigned int maxRank, float tolerance) const;
+
 protected:
     std::vector<float> _buf;
     unsigned int _rowsize;
@@ -34,6 +50,14 @@ protected:
 class Filter
 {
 public:
+
+    // execution backend : GLSL shader or CPU (headless hosts)
+    enum Backend
+    {
+        GPU,
+        CPU
+    };
+
     Filter();
     Filter(const Matrix& mat);
     virtual ~Filter();
@@ -43,17 +67,72 @@ public:
 
     void setMatrix(const Matrix& mat);
 
+    // run separable kernels as a horizontal then a vertical pass (enabled by default)
+    void setSeparable(bool enabled);
+
+    // kernels with at least this many non-zero coefficients go through the FFT on CPU.
+    // Measured once by a benchmark (when the CPU backend becomes the default, else on
+    // first use) unless set explicitly
+    static unsigned int fftCrossover();
+    static void setFFTCrossover(unsigned int taps);
+    static unsigned int calibrateFFTCrossover();
+
+    // backend used by filters created afterwards
+    static void setDefaultBackend(Backend backend);
+    static Backend defaultBackend();
+
+    void setBackend(Backend backend);
+    Backend backend() const {return _backend;}
+
     virtual const sf::Texture& apply(const sf::Texture& src);
 
+    // CPU path, doesn't need any GL context
+    const sf::Image& apply(const sf::Image& src);
+
+    // CPU path on a buffer of 1 to 4 channels (values in [0,1]), same layout result
+    const ImageBuffer<float>& apply(const ImageBuffer<float>& src);
+
+    // CPU path on a region of interest : only the region and its apron are read, the
+    // result has the region size (clipped to the image) and equals that part of the full result
+    const sf::Image& apply(const sf::Image& src, const sf::IntRect& roi);
+
+    // source pixels needed on each side of a region
+    virtual unsigned int apron() const;
+
+    // CPU kernel on RGBA float buffers (row-major, values in [0,1])
+    virtual void process(const float* src, float* dst, unsigned int width, unsigned int height);
+
     const sf::Texture& texture() const;
+    const sf::Image& image() const;
 
 protected:
     void resize(const sf::Vector2u& size);
 
-    sf::RenderTexture _target;
+    // kernel decompositions, whenever the matrix or the separable setting changes
+    virtual void updateKernel();
+
+    // set a kernel known to be separable, without going through the SVD
+    void setSeparableMatrix(const Matrix& horizontal, const Matrix& vertical);
+
+    sf::RenderTexture _target, _subtarget;
     sf::VertexBuffer _area;
     sf::Shader _shader;
     Matrix _matrix;
+
+    bool _separable;
+    std::vector<Matrix::SeparableTerm> _terms;
+    unsigned int _taps;
+    std::vector<float> _tmpBuffer;
+    FFTConvolution _fft;
+
+    Backend _backend;
+    sf::Texture _cpuTexture;
+    sf::Image _cpuImage;
+    ImageBuffer<float> _cpuResult;
+    std::vector<float> _srcBuffer, _dstBuffer;
+
+    static Backend s_defaultBackend;
+    static std::atomic<unsigned int> s_fftCrossover;
 };
 
 
@@ -66,6 +145,14 @@ public:
 
     void initialize() override;
     void cleanup() override;
+
+    void process(const float* src, float* dst, unsigned int width, unsigned int height) override;
+
+protected:
+    // gx and gy as horizontal then vertical passes (empty unless the kernel is rank-1)
+    void updateKernel() override;
+
+    std::vector<Matrix::SeparableTerm> _termsX, _termsY;
 };
 
 //--------------------------------------------------------------
@@ -74,6 +161,41 @@ struct BlurFilter : public Filter
     BlurFilter();
 };
 
+//--------------------------------------------------------------
+// Mean over a (2*radius+1)^2 window : separable passes on GPU,
+// summed-area table on CPU (constant cost per pixel for any radius)
+class BoxFilter : public Filter
+{
+public:
+    BoxFilter(unsigned int radius = 1);
+
+    void process(const float* src, float* dst, unsigned int width, unsigned int height) override;
+
+protected:
+    unsigned int _radius;
+    IntegralImage _tables[3];
+};
+
+//--------------------------------------------------------------
+// Gaussian blur of any sigma : sampled kernel of radius 3*sigma on GPU and on CPU
+// below sigma 5, recursive (Young - van Vliet) filter on CPU above, constant cost
+// per pixel and within one level of the sampled kernel
+class GaussianFilter : public Filter
+{
+public:
+    GaussianFilter(float sigma = 1.4f);
+
+    void process(const float* src, float* dst, unsigned int width, unsigned int height) override;
+
+    // sampled kernel radius, the recursive filter has an infinite support : 4 sigma
+    unsigned int apron() const override;
+
+protected:
+    float _sigma;
+    float _b[4];    // recursion coefficients, _b[0] is the input gain
+    float _m[9];    // Triggs - Sdika matrix, anti-causal initial conditions
+};
+
 //--------------------------------------------------------------
 struct SharpFilter : public Filter
 {
@@ -110,6 +232,8 @@ struct GradientsMap : public Filter
 
     void initialize() override;
     void cleanup() override;
+
+    void process(const float* src, float* dst, unsigned int width, unsigned int height) override;
 };
 
 
@@ -120,6 +244,8 @@ struct LocalMaximaFilter : public Filter
 
     void initialize() override;
     void cleanup() override;
+
+    void process(const float* src, float* dst, unsigned int width, unsigned int height) override;
 };
 
 #endif // FILTERING_HPP
@@ -0,0 +1,178 @@
+#include "histogram.hpp"
+
+#include "cpuBackend.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+// --------------------------------------------------------------------------
+Histogram::Histogram()
+    : m_binCount(0)
+{
+}
+
+// --------------------------------------------------------------------------
+Histogram::~Histogram()
+{
+}
+
+// --------------------------------------------------------------------------
+void Histogram::compute(const sf::Image& image, unsigned int channels, const sf::IntRect& roi, const std::vector<sf::Uint8>* mask)
+{
+    m_binCount = 256;
+    accumulate(imageView(image), channels, roi, mask);
+}
+
+// --------------------------------------------------------------------------
+void Histogram::compute(const sf::Uint16* data, unsigned int width, unsigned int height, unsigned int channelCount,
+                        unsigned int bits, unsigned int channels, const sf::IntRect& roi, const std::vector<sf::Uint8>* mask)
+{
+    m_binCount = 1u << std::min(bits, 16u);
+    accumulate(ImageBuffer<sf::Uint16>(const_cast<sf::Uint16*>(data), width, height, channelCount, width*channelCount), channels, roi, mask);
+}
+
+// --------------------------------------------------------------------------
+void Histogram::compute(const ImageBuffer<sf::Uint8>& buffer, unsigned int channels, const sf::IntRect& roi, const std::vector<sf::Uint8>* mask)
+{
+    m_binCount = 256;
+    accumulate(buffer, channels, roi, mask);
+}
+
+// --------------------------------------------------------------------------
+void Histogram::compute(const ImageBuffer<sf::Uint16>& buffer, unsigned int bits, unsigned int channels,
+                        const sf::IntRect& roi, const std::vector<sf::Uint8>* mask)
+{
+    m_binCount = 1u << std::min(bits, 16u);
+    accumulate(buffer, channels, roi, mask);
+}
+
+// --------------------------------------------------------------------------
+template<typename T>
+void Histogram::accumulate(const ImageBuffer<T>& buffer, unsigned int channels,
+                           const sf::IntRect& roi, const std::vector<sf::Uint8>* mask)
+{
+    const unsigned int width = buffer.width(), height = buffer.height(), channelCount = buffer.channels();
+
+    // region clipped to the image
+    sf::IntRect area(0, 0, width, height);
+    if(roi.width > 0 && roi.height > 0 && !roi.intersects(sf::IntRect(0, 0, width, height), area)) area = sf::IntRect();
+
+    m_bins.assign(channelCount, std::vector<unsigned int>());
+    std::vector<unsigned int> selected;
+    for(unsigned int c=0;c<channelCount;++c) if(channels & (1u<<c))
+    {
+        m_bins[c].assign(m_binCount, 0);
+        selected.push_back(c);
+    }
+    if(selected.empty() || area.width <= 0 || area.height <= 0) return;
+
+    const unsigned int last = m_binCount-1;
+    std::mutex binsMutex;
+    parallelFor(area.top, area.top+area.height, [&](unsigned int y0, unsigned int y1)
+    {
+        // private bins, 4 copies per channel so that equal consecutive values
+        // don't wait for each other's increment
+        std::vector<unsigned int> local(selected.size()*4*m_binCount, 0);
+
+        for(unsigned int s=0;s<selected.size();++s)
+        {
+            unsigned int c = selected[s];
+            unsigned int* b0 = &local[(s*4+0)*m_binCount];
+            unsigned int* b1 = &local[(s*4+1)*m_binCount];
+            unsigned int* b2 = &local[(s*4+2)*m_binCount];
+            unsigned int* b3 = &local[(s*4+3)*m_binCount];
+
+            for(unsigned int y=y0;y<y1;++y)
+            {
+                const T* row = buffer.row(y) + area.left*channelCount + c;
+                unsigned int n = area.width;
+
+                if(mask)
+                {
+                    const sf::Uint8* m = mask->data() + y*width + area.left;
+                    for(unsigned int x=0;x<n;++x) if(m[x]) b0[std::min<unsigned int>(row[x*channelCount], last)]++;
+                    continue;
+                }
+
+                unsigned int x = 0;
+                for(;x+4<=n;x+=4)
+                {
+                    b0[std::min<unsigned int>(row[(x+0)*channelCount], last)]++;
+                    b1[std::min<unsigned int>(row[(x+1)*channelCount], last)]++;
+                    b2[std::min<unsigned int>(row[(x+2)*channelCount], last)]++;
+                    b3[std::min<unsigned int>(row[(x+3)*channelCount], last)]++;
+                }
+                for(;x<n;++x) b0[std::min<unsigned int>(row[x*channelCount], last)]++;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(binsMutex);
+        for(unsigned int s=0;s<selected.size();++s)
+        {
+            std::vector<unsigned int>& bins = m_bins[selected[s]];
+            const unsigned int* b = &local[s*4*m_binCount];
+            for(unsigned int i=0;i<m_binCount;++i)
+                bins[i] += b[i] + b[m_binCount+i] + b[2*m_binCount+i] + b[3*m_binCount+i];
+        }
+    });
+}
+
+// --------------------------------------------------------------------------
+unsigned long long Histogram::total(unsigned int channel) const
+{
+    unsigned long long n = 0;
+    for(unsigned int v : m_bins[channel]) n += v;
+    return n;
+}
+
+// --------------------------------------------------------------------------
+double Histogram::mean(unsigned int channel) const
+{
+    const std::vector<unsigned int>& bins = m_bins[channel];
+    double n = 0.0, sum = 0.0;
+    for(unsigned int i=0;i<bins.size();++i) { n += bins[i]; sum += double(bins[i]) * i; }
+    return n > 0.0 ? sum/n : 0.0;
+}
+
+// --------------------------------------------------------------------------
+double Histogram::variance(unsigned int channel) const
+{
+    const std::vector<unsigned int>& bins = m_bins[channel];
+    double m = mean(channel), n = 0.0, sum = 0.0;
+    for(unsigned int i=0;i<bins.size();++i) { n += bins[i]; sum += double(bins[i]) * (i-m) * (i-m); }
+    return n > 0.0 ? sum/n : 0.0;
+}
+
+// --------------------------------------------------------------------------
+unsigned int Histogram::percentile(unsigned int channel, double p) const
+{
+    const std::vector<unsigned int>& bins = m_bins[channel];
+    double target = p * total(channel), acc = 0.0;
+    for(unsigned int i=0;i<bins.size();++i)
+    {
+        acc += bins[i];
+        if(acc >= target && acc > 0.0) return i;
+    }
+    return bins.empty() ? 0 : bins.size()-1;
+}
+
+// --------------------------------------------------------------------------
+std::vector<unsigned int> Histogram::equalization(unsigned int channel) const
+{
+    const std::vector<unsigned int>& bins = m_bins[channel];
+    std::vector<unsigned int> table(bins.size(), 0);
+
+    // cumulative distribution, stretched from the first used bin
+    unsigned long long n = total(channel), acc = 0, first = 0;
+    for(unsigned int i=0;i<bins.size() && first==0;++i) first = bins[i];
+    if(n == first) { for(unsigned int i=0;i<bins.size();++i) table[i] = i; return table; }
+
+    for(unsigned int i=0;i<bins.size();++i)
+    {
+        acc += bins[i];
+        double v = double(acc > first ? acc-first : 0) / double(n-first) * (m_binCount-1);
+        table[i] = (unsigned int)std::lround(v);
+    }
+    return table;
+}
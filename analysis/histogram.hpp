@@ -0,0 +1,68 @@
+#ifndef HISTOGRAM_HPP
+#define HISTOGRAM_HPP
+
+#include <SFML/Graphics.hpp>
+
+#include "imageBuffer.hpp"
+
+// --------------------------------------------------------------------------
+// Helper class - per channel histograms of 8 bits images or 16 bits buffers.
+// Rows are split between the workers, each one filling private bins reduced at the end.
+class Histogram
+{
+public:
+
+    enum Channel
+    {
+        Red = 1,
+        Green = 2,
+        Blue = 4,
+        Alpha = 8,
+        RGB = Red | Green | Blue
+    };
+
+    Histogram();
+    virtual ~Histogram();
+
+    // 256 bins per selected channel (Channel flags) of an image, restricted to a region
+    // (whole image when empty) and to the pixels where the mask (row-major, image size) is non zero
+    void compute( const sf::Image& image, unsigned int channels = Red,
+                  const sf::IntRect& roi = sf::IntRect(), const std::vector<sf::Uint8>* mask = nullptr );
+
+    // 2^bits bins per selected channel (bit i for channel i) of an interleaved 16 bits buffer,
+    // values above the range are counted in the last bin
+    void compute( const sf::Uint16* data, unsigned int width, unsigned int height, unsigned int channelCount,
+                  unsigned int bits = 16, unsigned int channels = 1,
+                  const sf::IntRect& roi = sf::IntRect(), const std::vector<sf::Uint8>* mask = nullptr );
+
+    // bins per selected channel (bit i for channel i) of a buffer : 256 for 8 bits, 2^bits for 16 bits
+    void compute( const ImageBuffer<sf::Uint8>& buffer, unsigned int channels = 1,
+                  const sf::IntRect& roi = sf::IntRect(), const std::vector<sf::Uint8>* mask = nullptr );
+    void compute( const ImageBuffer<sf::Uint16>& buffer, unsigned int bits = 16, unsigned int channels = 1,
+                  const sf::IntRect& roi = sf::IntRect(), const std::vector<sf::Uint8>* mask = nullptr );
+
+    unsigned int binCount() const {return m_binCount;}
+    unsigned int channelCount() const {return m_bins.size();}
+
+    // bins of a channel (index, not flag), empty when it was not selected
+    const std::vector<unsigned int>& bins(unsigned int channel) const {return m_bins[channel];}
+
+    // statistics of a channel
+    unsigned long long total(unsigned int channel) const;
+    double mean(unsigned int channel) const;
+    double variance(unsigned int channel) const;
+    unsigned int percentile(unsigned int channel, double p) const;     // smallest bin reaching p (0..1) of the total
+
+    // histogram equalization : new value of each bin, in [0, binCount-1]
+    std::vector<unsigned int> equalization(unsigned int channel) const;
+
+protected:
+    template<typename T>
+    void accumulate( const ImageBuffer<T>& buffer, unsigned int channels,
+                     const sf::IntRect& roi, const std::vector<sf::Uint8>* mask );
+
+    unsigned int m_binCount;
+    std::vector< std::vector<unsigned int> > m_bins;
+};
+
+#endif // HISTOGRAM_HPP
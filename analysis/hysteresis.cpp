@@ -0,0 +1,142 @@
+#include "hysteresis.hpp"
+
+#include "cpuBackend.hpp"
+
+// --------------------------------------------------------------------------
+// class values during tracking
+static const sf::Uint8 s_weak = 1;
+static const sf::Uint8 s_strong = 2;
+static const sf::Uint8 s_edge = 3;
+
+// --------------------------------------------------------------------------
+// mark as edge every weak/strong pixel reached from the stack, inside rows [y0,y1)
+static void grow(std::vector<sf::Uint8>& classes, int w, int y0, int y1, std::vector<int>& stack)
+{
+    while(!stack.empty())
+    {
+        int p = stack.back(); stack.pop_back();
+        int px = p % w, py = p / w;
+
+        for(int oy=-1;oy<=1;++oy) for(int ox=-1;ox<=1;++ox)
+        {
+            int nx = px+ox, ny = py+oy;
+            if(nx<0 || nx>=w || ny<y0 || ny>=y1) continue;
+
+            sf::Uint8& c = classes[ny*w+nx];
+            if(c==s_weak || c==s_strong) { c = s_edge; stack.push_back(ny*w+nx); }
+        }
+    }
+}
+
+// --------------------------------------------------------------------------
+Hysteresis::Hysteresis()
+{
+    initialize();
+}
+
+// --------------------------------------------------------------------------
+Hysteresis::~Hysteresis()
+{
+    cleanup();
+}
+
+// --------------------------------------------------------------------------
+void Hysteresis::initialize()
+{
+}
+
+// --------------------------------------------------------------------------
+void Hysteresis::cleanup()
+{
+}
+
+// --------------------------------------------------------------------------
+void Hysteresis::apply(std::vector<sf::Uint8>& classes, const sf::Vector2u& size)
+{
+    int w = size.x, h = size.y;
+    if(w==0 || h==0) return;
+
+    // tiles : bands of rows tracked independently
+    std::vector<sf::Uint8> seam(h, 0);
+    parallelFor(0, h, [&](unsigned int y0, unsigned int y1)
+    {
+        seam[y0] = 1;
+
+        std::vector<int> stack;
+        for(int i=y0*w;i<int(y1)*w;++i)
+        {
+            if(classes[i] != s_strong) continue;
+            classes[i] = s_edge;
+            stack.push_back(i);
+            grow(classes, w, y0, y1, stack);
+        }
+    });
+
+    // seams : weak pixels touching an edge of the band above or below seed a tracking
+    // over the whole image (only reaches pixels the bands couldn't)
+    std::vector<int> stack;
+    for(int y=1;y<h;++y)
+    {
+        if(!seam[y]) continue;
+        for(int x=0;x<w;++x) for(int ox=-1;ox<=1;++ox)
+        {
+            int nx = x+ox;
+            if(nx<0 || nx>=w) continue;
+
+            int above = (y-1)*w+x, below = y*w+nx;
+            if(classes[above]==s_edge && classes[below]==s_weak) { classes[below] = s_edge; stack.push_back(below); }
+            if(classes[below]==s_edge && classes[above]==s_weak) { classes[above] = s_edge; stack.push_back(above); }
+        }
+    }
+    grow(classes, w, 0, h, stack);
+
+    parallelFor(0, h, [&](unsigned int y0, unsigned int y1)
+    {
+        for(int i=y0*w;i<int(y1)*w;++i) classes[i] = (classes[i]==s_edge) ? 1 : 0;
+    });
+}
+
+// --------------------------------------------------------------------------
+const sf::Image& Hysteresis::apply(const sf::Image& image)
+{
+    apply(imageView(image));
+    bufferToImage(m_buffer, m_image);
+    return m_image;
+}
+
+// --------------------------------------------------------------------------
+const ImageBuffer<sf::Uint8>& Hysteresis::apply(const ImageBuffer<sf::Uint8>& buffer)
+{
+    sf::Vector2u size = buffer.size();
+    unsigned int ch = buffer.channels();
+
+    m_mask.resize(size.x*size.y);
+    for(unsigned int y=0;y<size.y;++y)
+    {
+        const sf::Uint8* px = buffer.row(y);
+        sf::Uint8* cls = &m_mask[y*size.x];
+        for(unsigned int x=0;x<size.x;++x)
+        {
+            sf::Uint8 r = px[x*ch];
+            cls[x] = r > 191 ? s_strong : (r > 63 ? s_weak : 0);
+        }
+    }
+
+    apply(m_mask, size);
+
+    m_buffer.create(size.x, size.y, 1);
+    for(unsigned int y=0;y<size.y;++y)
+    {
+        const sf::Uint8* cls = &m_mask[y*size.x];
+        sf::Uint8* dst = m_buffer.row(y);
+        for(unsigned int x=0;x<size.x;++x) dst[x] = cls[x] ? 255 : 0;
+    }
+
+    return m_buffer;
+}
+
+// --------------------------------------------------------------------------
+const sf::Image& Hysteresis::getResultAsImage()
+{
+    return m_image;
+}
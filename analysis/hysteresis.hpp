@@ -0,0 +1,42 @@
+#ifndef HYSTERESIS_HPP
+#define HYSTERESIS_HPP
+
+#include <SFML/Graphics.hpp>
+
+#include "imageBuffer.hpp"
+
+// --------------------------------------------------------------------------
+// Helper class - hysteresis edge tracking on CPU : weak pixels are kept when
+// 8-connected to a strong one. Works on a byte per pixel, tiles in parallel
+// then merges the seams between them.
+class Hysteresis
+{
+public:
+    Hysteresis();
+    virtual ~Hysteresis();
+
+    void initialize();
+    void cleanup();
+
+    // classes (0 none, 1 weak, 2 strong, row-major) replaced in place by a 0/1 edge mask
+    void apply( std::vector<sf::Uint8>& classes, const sf::Vector2u& size );
+
+    // binary edge image from a 3-values image (red channel : 0, 0.5, 1 like DoubleThreshold)
+    const sf::Image& apply( const sf::Image& image );
+
+    // same from the first channel of a buffer, single channel result (255 for edges)
+    const ImageBuffer<sf::Uint8>& apply( const ImageBuffer<sf::Uint8>& buffer );
+
+    // get result image (white edges)
+    const sf::Image& getResultAsImage();
+
+    // edge mask of the last image, 1 for edge pixels (row-major)
+    const std::vector<sf::Uint8>& getMask() const {return m_mask;}
+
+protected:
+    sf::Image m_image;                  // result image
+    ImageBuffer<sf::Uint8> m_buffer;    // result buffer
+    std::vector<sf::Uint8> m_mask;      // edge mask
+};
+
+#endif // HYSTERESIS_HPP
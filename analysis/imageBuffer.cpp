@@ -0,0 +1,72 @@
+#include "imageBuffer.hpp"
+
+// --------------------------------------------------------------------------
+const ImageBuffer<sf::Uint8> imageView(const sf::Image& image)
+{
+    sf::Vector2u size = image.getSize();
+    sf::Uint8* px = const_cast<sf::Uint8*>(image.getPixelsPtr());
+    return ImageBuffer<sf::Uint8>(px, size.x, size.y, 4, size.x*4);
+}
+
+// --------------------------------------------------------------------------
+void imageToBuffer(const sf::Image& image, ImageBuffer<sf::Uint8>& buffer, unsigned int channels)
+{
+    // red, red and alpha, RGB or RGBA
+    static const unsigned int sources[4][4] = {{0,0,0,0}, {0,3,0,0}, {0,1,2,0}, {0,1,2,3}};
+    const unsigned int* source = sources[std::min(std::max(channels, 1u), 4u)-1];
+
+    sf::Vector2u size = image.getSize();
+    buffer.create(size.x, size.y, channels);
+    const sf::Uint8* px = image.getPixelsPtr();
+
+    parallelFor(0, size.y, [&](unsigned int y0, unsigned int y1)
+    {
+        for(unsigned int y=y0;y<y1;++y)
+        {
+            const sf::Uint8* s = px + y*size.x*4;
+            sf::Uint8* d = buffer.row(y);
+            for(unsigned int x=0;x<size.x;++x,s+=4,d+=channels)
+                for(unsigned int c=0;c<channels;++c) d[c] = s[source[c]];
+        }
+    });
+}
+
+// --------------------------------------------------------------------------
+template<typename T>
+static void toImage(const ImageBuffer<T>& buffer, sf::Image& image, float scale)
+{
+    unsigned int w = buffer.width(), h = buffer.height(), ch = buffer.channels();
+    std::vector<sf::Uint8> pixels(w*h*4);
+
+    parallelFor(0, h, [&](unsigned int y0, unsigned int y1)
+    {
+        for(unsigned int y=y0;y<y1;++y)
+        {
+            const T* s = buffer.row(y);
+            sf::Uint8* d = &pixels[y*w*4];
+            for(unsigned int x=0;x<w;++x,s+=ch,d+=4)
+            {
+                if(ch < 3) { d[0] = d[1] = d[2] = saturateCast<sf::Uint8>(s[0]*scale); d[3] = (ch == 2) ? saturateCast<sf::Uint8>(s[1]*scale) : 255; }
+                else
+                {
+                    d[0] = saturateCast<sf::Uint8>(s[0]*scale); d[1] = saturateCast<sf::Uint8>(s[1]*scale); d[2] = saturateCast<sf::Uint8>(s[2]*scale);
+                    d[3] = (ch == 4) ? saturateCast<sf::Uint8>(s[3]*scale) : 255;
+                }
+            }
+        }
+    });
+
+    image.create(w, h, pixels.data());
+}
+
+// --------------------------------------------------------------------------
+void bufferToImage(const ImageBuffer<sf::Uint8>& buffer, sf::Image& image)
+{
+    toImage(buffer, image, 1.0f);
+}
+
+// --------------------------------------------------------------------------
+void bufferToImage(const ImageBuffer<float>& buffer, sf::Image& image)
+{
+    toImage(buffer, image, 255.0f);
+}
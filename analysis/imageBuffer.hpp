@@ -0,0 +1,257 @@
+#ifndef IMAGE_BUFFER_HPP
+#define IMAGE_BUFFER_HPP
+
+#include <SFML/Graphics.hpp>
+
+#include "cpuBackend.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <type_traits>
+
+// --------------------------------------------------------------------------
+// Helper class - 2D buffer of 1 to 4 interleaved channels of T (sf::Uint8, sf::Uint16,
+// float...), independent of SFML. Rows start on 64 bytes boundaries, stride() elements
+// apart. Copies and views share the pixels, clone() makes a deep copy.
+template<typename T>
+class ImageBuffer
+{
+public:
+    static const unsigned int alignment = 64;
+
+    ImageBuffer();
+    ImageBuffer(unsigned int width, unsigned int height, unsigned int channels = 1);
+
+    // external pixels, not owned : they must outlive the buffer and its views
+    ImageBuffer(T* data, unsigned int width, unsigned int height, unsigned int channels, unsigned int stride);
+
+    // new layout, values are left undefined. The allocation is kept when it is
+    // large enough and not shared with another buffer or view
+    void create(unsigned int width, unsigned int height, unsigned int channels = 1);
+
+    // region of the pixels (clipped to the buffer), sharing them
+    ImageBuffer view(const sf::IntRect& roi) const;
+
+    // deep copy with its own aligned rows
+    ImageBuffer clone() const;
+
+    void fill(T value);
+
+    unsigned int width() const {return m_width;}
+    unsigned int height() const {return m_height;}
+    unsigned int channels() const {return m_channels;}
+    unsigned int stride() const {return m_stride;}      // elements between two rows
+    sf::Vector2u size() const {return sf::Vector2u(m_width, m_height);}
+    bool empty() const {return m_width == 0 || m_height == 0;}
+    bool isContiguous() const {return m_stride == m_width*m_channels;}
+
+    T* row(unsigned int y) {return m_data + std::size_t(y)*m_stride;}
+    const T* row(unsigned int y) const {return m_data + std::size_t(y)*m_stride;}
+    T& at(unsigned int x, unsigned int y, unsigned int c = 0) {return row(y)[x*m_channels+c];}
+    const T& at(unsigned int x, unsigned int y, unsigned int c = 0) const {return row(y)[x*m_channels+c];}
+
+protected:
+    std::shared_ptr<unsigned char> m_storage;   // owned allocation (null for external pixels)
+    std::size_t m_capacity;                     // bytes of the allocation
+    T* m_data;
+    unsigned int m_width, m_height, m_channels, m_stride;
+};
+
+// --------------------------------------------------------------------------
+// SFML adapters
+
+// read-only RGBA view of an image, no copy : valid while the image is unchanged
+const ImageBuffer<sf::Uint8> imageView(const sf::Image& image);
+
+// first channels of an image (1 : red, 2 : red and alpha, 3 : RGB, 4 : RGBA)
+void imageToBuffer(const sf::Image& image, ImageBuffer<sf::Uint8>& buffer, unsigned int channels = 4);
+
+// image of a buffer (1 channel : gray, 2 : gray and alpha, 3 : RGB, 4 : RGBA),
+// float values in [0,1]
+void bufferToImage(const ImageBuffer<sf::Uint8>& buffer, sf::Image& image);
+void bufferToImage(const ImageBuffer<float>& buffer, sf::Image& image);
+
+// --------------------------------------------------------------------------
+// channel conversions
+
+// dst = src * scale, rounded and saturated for integer types, same layout
+template<typename S, typename D>
+void convert(const ImageBuffer<S>& src, ImageBuffer<D>& dst, float scale = 1.0f);
+
+// RGBA float buffer (row-major) of a buffer, values multiplied by scale : 1 or 2 channels
+// are replicated in red, green and blue, missing alpha is opaque
+template<typename T>
+void bufferToRGBA(const ImageBuffer<T>& buffer, std::vector<float>& rgba, float scale = 1.0f);
+
+// first channels of a RGBA float buffer, values multiplied by scale (rounded and saturated)
+template<typename T>
+void rgbaToBuffer(const std::vector<float>& rgba, ImageBuffer<T>& buffer, float scale = 1.0f);
+
+
+// --------------------------------------------------------------------------
+template<typename T>
+ImageBuffer<T>::ImageBuffer()
+    : m_capacity(0)
+    , m_data(nullptr)
+    , m_width(0)
+    , m_height(0)
+    , m_channels(1)
+    , m_stride(0)
+{
+}
+
+// --------------------------------------------------------------------------
+template<typename T>
+ImageBuffer<T>::ImageBuffer(unsigned int width, unsigned int height, unsigned int channels)
+    : ImageBuffer()
+{
+    create(width, height, channels);
+}
+
+// --------------------------------------------------------------------------
+template<typename T>
+ImageBuffer<T>::ImageBuffer(T* data, unsigned int width, unsigned int height, unsigned int channels, unsigned int stride)
+    : m_capacity(0)
+    , m_data(data)
+    , m_width(width)
+    , m_height(height)
+    , m_channels(channels)
+    , m_stride(stride)
+{
+}
+
+// --------------------------------------------------------------------------
+template<typename T>
+void ImageBuffer<T>::create(unsigned int width, unsigned int height, unsigned int channels)
+{
+    std::size_t rowBytes = (std::size_t(width)*channels*sizeof(T) + alignment-1) / alignment * alignment;
+    std::size_t bytes = rowBytes*height + alignment;
+
+    if(!m_storage || m_storage.use_count() > 1 || m_capacity < bytes)
+    {
+        m_storage.reset(new unsigned char[bytes], std::default_delete<unsigned char[]>());
+        m_capacity = bytes;
+    }
+
+    std::uintptr_t address = reinterpret_cast<std::uintptr_t>(m_storage.get());
+    m_data = reinterpret_cast<T*>((address + alignment-1) / alignment * alignment);
+    m_width = width;
+    m_height = height;
+    m_channels = channels;
+    m_stride = rowBytes / sizeof(T);
+}
+
+// --------------------------------------------------------------------------
+template<typename T>
+ImageBuffer<T> ImageBuffer<T>::view(const sf::IntRect& roi) const
+{
+    int x0 = std::max(roi.left, 0), y0 = std::max(roi.top, 0);
+    int x1 = std::min(roi.left+roi.width, int(m_width)), y1 = std::min(roi.top+roi.height, int(m_height));
+
+    ImageBuffer result(*this);
+    if(x1 <= x0 || y1 <= y0)
+    {
+        result.m_width = 0;
+        result.m_height = 0;
+        return result;
+    }
+
+    result.m_data = m_data + std::size_t(y0)*m_stride + x0*m_channels;
+    result.m_width = x1-x0;
+    result.m_height = y1-y0;
+    return result;
+}
+
+// --------------------------------------------------------------------------
+template<typename T>
+ImageBuffer<T> ImageBuffer<T>::clone() const
+{
+    ImageBuffer result(m_width, m_height, m_channels);
+    for(unsigned int y=0;y<m_height;++y) std::copy(row(y), row(y)+m_width*m_channels, result.row(y));
+    return result;
+}
+
+// --------------------------------------------------------------------------
+template<typename T>
+void ImageBuffer<T>::fill(T value)
+{
+    for(unsigned int y=0;y<m_height;++y) std::fill(row(y), row(y)+m_width*m_channels, value);
+}
+
+// --------------------------------------------------------------------------
+// value * scale stored as D
+template<typename D>
+inline D saturateCast(float v)
+{
+    if(std::is_integral<D>::value)
+    {
+        v = std::min(std::max(v + 0.5f, float(std::numeric_limits<D>::min())), float(std::numeric_limits<D>::max()));
+    }
+    return D(v);
+}
+
+// --------------------------------------------------------------------------
+template<typename S, typename D>
+void convert(const ImageBuffer<S>& src, ImageBuffer<D>& dst, float scale)
+{
+    dst.create(src.width(), src.height(), src.channels());
+    unsigned int n = src.width()*src.channels();
+
+    parallelFor(0, src.height(), [&](unsigned int y0, unsigned int y1)
+    {
+        for(unsigned int y=y0;y<y1;++y)
+        {
+            const S* s = src.row(y);
+            D* d = dst.row(y);
+            for(unsigned int i=0;i<n;++i) d[i] = saturateCast<D>(s[i]*scale);
+        }
+    });
+}
+
+// --------------------------------------------------------------------------
+template<typename T>
+void bufferToRGBA(const ImageBuffer<T>& buffer, std::vector<float>& rgba, float scale)
+{
+    unsigned int w = buffer.width(), ch = buffer.channels();
+    rgba.resize(std::size_t(w)*buffer.height()*4);
+
+    parallelFor(0, buffer.height(), [&](unsigned int y0, unsigned int y1)
+    {
+        for(unsigned int y=y0;y<y1;++y)
+        {
+            const T* s = buffer.row(y);
+            float* d = &rgba[std::size_t(y)*w*4];
+            for(unsigned int x=0;x<w;++x,s+=ch,d+=4)
+            {
+                if(ch < 3) { d[0] = d[1] = d[2] = s[0]*scale; d[3] = (ch == 2) ? s[1]*scale : 1.0f; }
+                else { d[0] = s[0]*scale; d[1] = s[1]*scale; d[2] = s[2]*scale; d[3] = (ch == 4) ? s[3]*scale : 1.0f; }
+            }
+        }
+    });
+}
+
+// --------------------------------------------------------------------------
+template<typename T>
+void rgbaToBuffer(const std::vector<float>& rgba, ImageBuffer<T>& buffer, float scale)
+{
+    unsigned int w = buffer.width(), ch = buffer.channels();
+
+    parallelFor(0, buffer.height(), [&](unsigned int y0, unsigned int y1)
+    {
+        for(unsigned int y=y0;y<y1;++y)
+        {
+            const float* s = &rgba[std::size_t(y)*w*4];
+            T* d = buffer.row(y);
+            for(unsigned int x=0;x<w;++x,s+=4,d+=ch)
+            {
+                if(ch == 2) { d[0] = saturateCast<T>(s[0]*scale); d[1] = saturateCast<T>(s[3]*scale); }
+                else for(unsigned int c=0;c<ch;++c) d[c] = saturateCast<T>(s[c]*scale);
+            }
+        }
+    });
+}
+
+#endif // IMAGE_BUFFER_HPP
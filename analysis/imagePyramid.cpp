@@ -0,0 +1,211 @@
+#include "imagePyramid.hpp"
+
+#include "cpuBackend.hpp"
+
+#include <algorithm>
+
+// --------------------------------------------------------------------------
+ImagePyramid::ImagePyramid(Reduction reduction)
+    : m_reduction(reduction)
+{
+    initialize();
+}
+
+// --------------------------------------------------------------------------
+ImagePyramid::~ImagePyramid()
+{
+    cleanup();
+}
+
+// --------------------------------------------------------------------------
+void ImagePyramid::initialize()
+{
+}
+
+// --------------------------------------------------------------------------
+void ImagePyramid::cleanup()
+{
+    m_sizes.clear();
+    m_levels.clear();
+    m_valid.clear();
+    m_images.clear();
+    m_imageValid.clear();
+}
+
+// --------------------------------------------------------------------------
+void ImagePyramid::setReduction(Reduction reduction)
+{
+    if(reduction == m_reduction) return;
+    m_reduction = reduction;
+    for(unsigned int i=1;i<m_valid.size();++i) m_valid[i] = m_imageValid[i] = false;
+}
+
+// --------------------------------------------------------------------------
+void ImagePyramid::layout(sf::Vector2u size)
+{
+    m_sizes.clear();
+    if(size.x > 0 && size.y > 0)
+    {
+        m_sizes.push_back(size);
+        while(size.x > 1 || size.y > 1)
+        {
+            size = sf::Vector2u((size.x+1)/2, (size.y+1)/2);
+            m_sizes.push_back(size);
+        }
+    }
+
+    if(m_levels.size() < m_sizes.size()) m_levels.resize(m_sizes.size());
+    if(m_images.size() < m_sizes.size()) m_images.resize(m_sizes.size());
+    m_valid.assign(m_sizes.size(), false);
+    m_imageValid.assign(m_sizes.size(), false);
+}
+
+// --------------------------------------------------------------------------
+void ImagePyramid::setImage(const sf::Image& image)
+{
+    layout(image.getSize());
+    if(m_sizes.empty()) return;
+
+    // the level 0 buffer views the kept image
+    m_images[0] = image;
+    m_imageValid[0] = true;
+    m_levels[0] = imageView(m_images[0]);
+    m_valid[0] = true;
+}
+
+// --------------------------------------------------------------------------
+void ImagePyramid::setImage(const ImageBuffer<sf::Uint8>& buffer)
+{
+    layout(buffer.size());
+    if(m_sizes.empty()) return;
+
+    // RGBA like the images : gray replicated, missing alpha opaque
+    unsigned int w = buffer.width(), ch = buffer.channels();
+    ImageBuffer<sf::Uint8>& dst = m_levels[0];
+    dst.create(w, buffer.height(), 4);
+    parallelFor(0, buffer.height(), [&](unsigned int y0, unsigned int y1)
+    {
+        for(unsigned int y=y0;y<y1;++y)
+        {
+            const sf::Uint8* s = buffer.row(y);
+            sf::Uint8* d = dst.row(y);
+            for(unsigned int x=0;x<w;++x,s+=ch,d+=4)
+            {
+                if(ch < 3) { d[0] = d[1] = d[2] = s[0]; d[3] = (ch == 2) ? s[1] : 255; }
+                else { d[0] = s[0]; d[1] = s[1]; d[2] = s[2]; d[3] = (ch == 4) ? s[3] : 255; }
+            }
+        }
+    });
+    m_valid[0] = true;
+}
+
+// --------------------------------------------------------------------------
+const ImageBuffer<sf::Uint8>& ImagePyramid::levelView(unsigned int index)
+{
+    if(m_sizes.empty())
+    {
+        if(m_levels.empty()) m_levels.resize(1);
+        m_levels[0] = ImageBuffer<sf::Uint8>();
+        return m_levels[0];
+    }
+
+    index = std::min<unsigned int>(index, m_sizes.size()-1);
+    unsigned int first = index;
+    while(!m_valid[first]) --first;
+    for(unsigned int i=first;i<index;++i) reduce(i);
+    return m_levels[index];
+}
+
+// --------------------------------------------------------------------------
+const sf::Image& ImagePyramid::level(unsigned int index)
+{
+    if(m_sizes.empty())
+    {
+        if(m_images.empty()) m_images.resize(1);
+        m_images[0].create(0, 0);
+        return m_images[0];
+    }
+
+    index = std::min<unsigned int>(index, m_sizes.size()-1);
+    if(!m_imageValid[index])
+    {
+        bufferToImage(levelView(index), m_images[index]);
+        m_imageValid[index] = true;
+    }
+    return m_images[index];
+}
+
+// --------------------------------------------------------------------------
+void ImagePyramid::reduce(unsigned int index)
+{
+    // separable integer kernel around 2x+0.5 : taps 2x-1..2x+2 or 2x..2x+1, edges clamped
+    static const unsigned int gaussian[4] = {1, 3, 3, 1};
+    static const unsigned int box[2] = {1, 1};
+    const unsigned int* kernel = (m_reduction == Gaussian) ? gaussian : box;
+    const int taps = (m_reduction == Gaussian) ? 4 : 2;
+    const int first = (m_reduction == Gaussian) ? -1 : 0;
+    const int shift = (m_reduction == Gaussian) ? 6 : 2;
+
+    const sf::Vector2u& srcSize = m_sizes[index];
+    const sf::Vector2u& dstSize = m_sizes[index+1];
+    const ImageBuffer<sf::Uint8>& src = m_levels[index];
+    ImageBuffer<sf::Uint8>& dst = m_levels[index+1];
+    dst.create(dstSize.x, dstSize.y, 4);
+
+    const int sw = srcSize.x, sh = srcSize.y;
+    parallelFor(0, dstSize.y, [&](unsigned int y0, unsigned int y1)
+    {
+        std::vector<unsigned int> row(dstSize.x*4), acc(dstSize.x*4);
+        for(unsigned int y=y0;y<y1;++y)
+        {
+            std::fill(acc.begin(), acc.end(), 0);
+            for(int j=0;j<taps;++j)
+            {
+                int sy = std::min(std::max(int(2*y)+first+j, 0), sh-1);
+                const sf::Uint8* line = src.row(sy);
+
+                // horizontal pass of the source row
+                for(unsigned int x=0;x<dstSize.x;++x)
+                {
+                    unsigned int s[4] = {0, 0, 0, 0};
+                    for(int i=0;i<taps;++i)
+                    {
+                        const sf::Uint8* p = line + std::min(std::max(int(2*x)+first+i, 0), sw-1)*4;
+                        s[0] += kernel[i]*p[0]; s[1] += kernel[i]*p[1]; s[2] += kernel[i]*p[2]; s[3] += kernel[i]*p[3];
+                    }
+                    for(int c=0;c<4;++c) row[x*4+c] = s[c];
+                }
+
+                for(unsigned int i=0;i<acc.size();++i) acc[i] += kernel[j]*row[i];
+            }
+
+            sf::Uint8* out = dst.row(y);
+            for(unsigned int i=0;i<acc.size();++i) out[i] = (sf::Uint8)((acc[i] + (1u << (shift-1))) >> shift);
+        }
+    });
+
+    m_valid[index+1] = true;
+    m_imageValid[index+1] = false;
+}
+
+// --------------------------------------------------------------------------
+sf::Vector2f ImagePyramid::toFullResolution(const sf::Vector2f& position, unsigned int index) const
+{
+    // pixel x of level n covers [x*2^n, (x+1)*2^n) of level 0
+    float s = scale(index);
+    return sf::Vector2f((position.x+0.5f)*s - 0.5f, (position.y+0.5f)*s - 0.5f);
+}
+
+// --------------------------------------------------------------------------
+sf::IntRect ImagePyramid::toFullResolution(const sf::IntRect& rect, unsigned int index) const
+{
+    int s = 1 << index;
+    sf::IntRect r(rect.left*s, rect.top*s, rect.width*s, rect.height*s);
+    if(m_sizes.empty()) return r;
+
+    // odd sizes : the last pixels cover less
+    int w = m_sizes[0].x, h = m_sizes[0].y;
+    r.width = std::min(r.left+r.width, w) - r.left;
+    r.height = std::min(r.top+r.height, h) - r.top;
+    return r;
+}
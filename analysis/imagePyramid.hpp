@@ -0,0 +1,70 @@
+#ifndef IMAGE_PYRAMID_HPP
+#define IMAGE_PYRAMID_HPP
+
+#include <SFML/Graphics.hpp>
+
+#include "imageBuffer.hpp"
+
+// --------------------------------------------------------------------------
+// Helper class - multi-scale cache of an image. Level 0 is the image, each level
+// is half the size (rounded up) of the one above and built from it on first use.
+// Levels are RGBA buffers reused by the next images, their sf::Image is only
+// built when asked for.
+class ImagePyramid
+{
+public:
+
+    enum Reduction
+    {
+        Box,            // 2x2 averages
+        Gaussian        // [1 3 3 1]/8 binomial on both axes, then decimation
+    };
+
+    ImagePyramid(Reduction reduction = Gaussian);
+    virtual ~ImagePyramid();
+
+    void initialize();
+    void cleanup();
+
+    void setReduction(Reduction reduction);
+
+    // new level 0, the other levels are rebuilt on demand
+    void setImage(const sf::Image& image);
+    void setImage(const ImageBuffer<sf::Uint8>& buffer);   // 1 channel : gray, 3 : RGB...
+
+    // levels down to a 1x1 image
+    unsigned int levelCount() const {return m_sizes.size();}
+    const sf::Vector2u& levelSize(unsigned int index) const {return m_sizes[index];}
+
+    // image of a level (clamped to the last one)
+    const sf::Image& level(unsigned int index);
+
+    // RGBA buffer of a level (clamped to the last one), valid until the next image
+    const ImageBuffer<sf::Uint8>& levelView(unsigned int index);
+
+    // run an operator having an apply(const sf::Image&, ...) (Filter, Morphology,
+    // BlobAnalysis, CannyDetector...) on a level
+    template<typename Operator, typename... Args>
+    const sf::Image& apply(Operator& op, unsigned int index, Args... args) {return op.apply(level(index), args...);}
+
+    // level coordinates to level 0 ones : pixel centers for points, covered area for rectangles
+    float scale(unsigned int index) const {return float(1u << index);}
+    sf::Vector2f toFullResolution(const sf::Vector2f& position, unsigned int index) const;
+    sf::IntRect toFullResolution(const sf::IntRect& rect, unsigned int index) const;
+
+protected:
+    // level sizes of a new level 0, no level built
+    void layout(sf::Vector2u size);
+
+    // level index+1 from level index, written in place in its buffer
+    void reduce(unsigned int index);
+
+    Reduction m_reduction;
+    std::vector<sf::Vector2u> m_sizes;
+    std::vector< ImageBuffer<sf::Uint8> > m_levels;     // RGBA, pool never shrunk
+    std::vector<bool> m_valid;
+    std::vector<sf::Image> m_images;                    // levels asked as images
+    std::vector<bool> m_imageValid;
+};
+
+#endif // IMAGE_PYRAMID_HPP
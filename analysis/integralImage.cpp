@@ -0,0 +1,184 @@
+#include "integralImage.hpp"
+
+#include "cpuBackend.hpp"
+
+#include <algorithm>
+
+// --------------------------------------------------------------------------
+IntegralImage::IntegralImage()
+    : _border(0)
+{
+}
+
+// --------------------------------------------------------------------------
+IntegralImage::~IntegralImage()
+{
+}
+
+// --------------------------------------------------------------------------
+void IntegralImage::compute(const float* src, unsigned int width, unsigned int height,
+                            unsigned int channel, unsigned int border, bool squares)
+{
+    _size = sf::Vector2u(width, height);
+    _border = border;
+    build([&](unsigned int x, unsigned int y){ return src[(y*width+x)*4+channel]; }, squares);
+}
+
+// --------------------------------------------------------------------------
+void IntegralImage::compute(const sf::Image& image, unsigned int channel, unsigned int border, bool squares)
+{
+    const sf::Uint8* px = image.getPixelsPtr();
+    unsigned int width = image.getSize().x;
+
+    _size = image.getSize();
+    _border = border;
+    build([&](unsigned int x, unsigned int y){ return px[(y*width+x)*4+channel] / 255.0f; }, squares);
+}
+
+// --------------------------------------------------------------------------
+void IntegralImage::compute(const ImageBuffer<float>& buffer, unsigned int channel, unsigned int border, bool squares)
+{
+    unsigned int ch = buffer.channels();
+
+    _size = buffer.size();
+    _border = border;
+    build([&](unsigned int x, unsigned int y){ return buffer.row(y)[x*ch+channel]; }, squares);
+}
+
+// --------------------------------------------------------------------------
+void IntegralImage::compute(const ImageBuffer<sf::Uint8>& buffer, unsigned int channel, unsigned int border, bool squares)
+{
+    unsigned int ch = buffer.channels();
+
+    _size = buffer.size();
+    _border = border;
+    build([&](unsigned int x, unsigned int y){ return buffer.row(y)[x*ch+channel] / 255.0f; }, squares);
+}
+
+// --------------------------------------------------------------------------
+void IntegralImage::build(const std::function<float(unsigned int, unsigned int)>& value, bool squares)
+{
+    int b = _border;
+    unsigned int tw = _size.x + 2*b + 1;
+    unsigned int th = _size.y + 2*b + 1;
+
+    _sum.resize(tw*th);
+    if(squares) _sqsum.resize(tw*th); else _sqsum.clear();
+
+    if(_size.x==0 || _size.y==0) { std::fill(_sum.begin(), _sum.end(), 0.0); return; }
+
+    std::fill(_sum.begin(), _sum.begin()+tw, 0.0);
+    if(squares) std::fill(_sqsum.begin(), _sqsum.begin()+tw, 0.0);
+
+    // row prefix sums
+    parallelFor(1, th, [&](unsigned int y0, unsigned int y1)
+    {
+        for(unsigned int ty=y0;ty<y1;++ty)
+        {
+            unsigned int y = std::min(std::max(int(ty)-1-b, 0), int(_size.y)-1);
+            double acc = 0.0, acc2 = 0.0;
+            _sum[ty*tw] = 0.0;
+            if(squares) _sqsum[ty*tw] = 0.0;
+            for(unsigned int tx=1;tx<tw;++tx)
+            {
+                unsigned int x = std::min(std::max(int(tx)-1-b, 0), int(_size.x)-1);
+                double v = value(x,y);
+                acc += v;
+                _sum[ty*tw+tx] = acc;
+                if(squares) { acc2 += v*v; _sqsum[ty*tw+tx] = acc2; }
+            }
+        }
+    });
+
+    // column accumulation, each worker owns a range of columns
+    parallelFor(1, tw, [&](unsigned int x0, unsigned int x1)
+    {
+        for(unsigned int ty=2;ty<th;++ty) for(unsigned int tx=x0;tx<x1;++tx)
+        {
+            _sum[ty*tw+tx] += _sum[(ty-1)*tw+tx];
+            if(squares) _sqsum[ty*tw+tx] += _sqsum[(ty-1)*tw+tx];
+        }
+    });
+}
+
+// --------------------------------------------------------------------------
+bool IntegralImage::clip(int& x0, int& y0, int& x1, int& y1) const
+{
+    int b = _border;
+    x0 = std::max(x0, -b); y0 = std::max(y0, -b);
+    x1 = std::min(x1, int(_size.x)+b-1); y1 = std::min(y1, int(_size.y)+b-1);
+    return x0<=x1 && y0<=y1;
+}
+
+// --------------------------------------------------------------------------
+double IntegralImage::lookup(const std::vector<double>& table, int x0, int y0, int x1, int y1) const
+{
+    if(table.empty() || !clip(x0,y0,x1,y1)) return 0.0;
+
+    unsigned int tw = _size.x + 2*_border + 1;
+    int b = _border;
+    unsigned int ax = x0+b, ay = y0+b, bx = x1+b+1, by = y1+b+1;
+    return table[by*tw+bx] - table[ay*tw+bx] - table[by*tw+ax] + table[ay*tw+ax];
+}
+
+// --------------------------------------------------------------------------
+double IntegralImage::sum(int x0, int y0, int x1, int y1) const
+{
+    return lookup(_sum, x0,y0,x1,y1);
+}
+
+// --------------------------------------------------------------------------
+double IntegralImage::squaredSum(int x0, int y0, int x1, int y1) const
+{
+    return lookup(_sqsum, x0,y0,x1,y1);
+}
+
+// --------------------------------------------------------------------------
+unsigned int IntegralImage::count(int x0, int y0, int x1, int y1) const
+{
+    if(!clip(x0,y0,x1,y1)) return 0;
+    return (x1-x0+1)*(y1-y0+1);
+}
+
+// --------------------------------------------------------------------------
+double IntegralImage::mean(int x0, int y0, int x1, int y1) const
+{
+    unsigned int n = count(x0,y0,x1,y1);
+    return n>0 ? sum(x0,y0,x1,y1) / n : 0.0;
+}
+
+// --------------------------------------------------------------------------
+double IntegralImage::variance(int x0, int y0, int x1, int y1) const
+{
+    unsigned int n = count(x0,y0,x1,y1);
+    if(n==0) return 0.0;
+
+    double m = sum(x0,y0,x1,y1) / n;
+    return std::max(squaredSum(x0,y0,x1,y1) / n - m*m, 0.0);
+}
+
+// --------------------------------------------------------------------------
+void IntegralImage::localMean(unsigned int radius, std::vector<float>& out) const
+{
+    out.resize(_size.x*_size.y);
+    int r = radius;
+
+    parallelFor(0, _size.y, [&](unsigned int y0, unsigned int y1)
+    {
+        for(int y=y0;y<(int)y1;++y) for(int x=0;x<(int)_size.x;++x)
+            out[y*_size.x+x] = float(mean(x-r, y-r, x+r, y+r));
+    });
+}
+
+// --------------------------------------------------------------------------
+void IntegralImage::localVariance(unsigned int radius, std::vector<float>& out) const
+{
+    out.resize(_size.x*_size.y);
+    int r = radius;
+
+    parallelFor(0, _size.y, [&](unsigned int y0, unsigned int y1)
+    {
+        for(int y=y0;y<(int)y1;++y) for(int x=0;x<(int)_size.x;++x)
+            out[y*_size.x+x] = float(variance(x-r, y-r, x+r, y+r));
+    });
+}
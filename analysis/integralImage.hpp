@@ -0,0 +1,54 @@
+#ifndef INTEGRAL_IMAGE_HPP
+#define INTEGRAL_IMAGE_HPP
+
+#include <SFML/Graphics.hpp>
+
+#include "imageBuffer.hpp"
+
+#include <functional>
+
+// --------------------------------------------------------------------------
+// Helper class - summed-area table of one channel (and of its squares).
+// Any window sum costs 4 lookups ; the table is kept between calls.
+class IntegralImage
+{
+public:
+    IntegralImage();
+    virtual ~IntegralImage();
+
+    // build the table from a channel of a RGBA float buffer (values in [0,1]) or of an image.
+    // border extends the table with edge-replicated pixels on each side
+    void compute(const float* src, unsigned int width, unsigned int height,
+                 unsigned int channel = 0, unsigned int border = 0, bool squares = true);
+    void compute(const sf::Image& image, unsigned int channel = 0, unsigned int border = 0, bool squares = true);
+
+    // same from a channel of a buffer, byte values being scaled to [0,1]
+    void compute(const ImageBuffer<float>& buffer, unsigned int channel = 0, unsigned int border = 0, bool squares = true);
+    void compute(const ImageBuffer<sf::Uint8>& buffer, unsigned int channel = 0, unsigned int border = 0, bool squares = true);
+
+    // statistics over [x0,x1]x[y0,y1] (inclusive, image coordinates), clipped to the table
+    double sum(int x0, int y0, int x1, int y1) const;
+    double squaredSum(int x0, int y0, int x1, int y1) const;
+    unsigned int count(int x0, int y0, int x1, int y1) const;
+    double mean(int x0, int y0, int x1, int y1) const;
+    double variance(int x0, int y0, int x1, int y1) const;
+
+    // per pixel statistics over a (2*radius+1)^2 window, row-major
+    void localMean(unsigned int radius, std::vector<float>& out) const;
+    void localVariance(unsigned int radius, std::vector<float>& out) const;
+
+    const sf::Vector2u& size() const {return _size;}
+    unsigned int border() const {return _border;}
+
+protected:
+    void build(const std::function<float(unsigned int, unsigned int)>& value, bool squares);
+    bool clip(int& x0, int& y0, int& x1, int& y1) const;
+    double lookup(const std::vector<double>& table, int x0, int y0, int x1, int y1) const;
+
+    std::vector<double> _sum;       // (w+2*border+1) x (h+2*border+1)
+    std::vector<double> _sqsum;     // same layout, empty if squares weren't requested
+    sf::Vector2u _size;
+    unsigned int _border;
+};
+
+#endif // INTEGRAL_IMAGE_HPP
@@ -1,7 +1,9 @@
 #include "morphology.hpp"
 
 #include "filtering.hpp"
+#include "cpuBackend.hpp"
 
+#include <algorithm>
 #include <iostream>
 
 // --------------------------------------------------------------------------
@@ -25,6 +27,8 @@ static const std::string s_glsl_morpho = GLSL_CODE(
     uniform vec2 u_srcsize;
     uniform vec2 u_matrixsize;
     uniform int u_optype;
+    uniform int u_combine;      // 0 : result, 1 : reference - result, 2 : result - reference
+    uniform sampler2D u_ref;
 
     float mat_coef(vec2 st)
     {
@@ -56,14 +60,122 @@ static const std::string s_glsl_morpho = GLSL_CODE(
             }
         }
 
-        gl_FragColor = vec4(acc, 1.0);
+        if(u_combine==1) acc = texture2D(u_ref, uv).xyz - acc;
+        if(u_combine==2) acc = acc - texture2D(u_ref, uv).xyz;
+
+        gl_FragColor = vec4(max(acc, vec3(0.0)), 1.0);
     }
 );
 
 
+// --------------------------------------------------------------------------
+// uniform array size of the shader
+static const unsigned int s_maxShaderTaps = 81;
+
+// --------------------------------------------------------------------------
+// van Herk/Gil-Werman running min/max of a window of k values starting k/2 before
+// each output, edges replicated. `lanes` contiguous sequences of n values, `stride`
+// apart, are processed together. Blocks of k values get their prefix (g) and suffix (h)
+// extrema, a window then overlaps two blocks : out[x] = op(h[x], g[x+k-1])
+template<bool Erosion>
+static void vanHerkGilWerman(const float* src, float* dst, int n, int stride, int lanes, int k, std::vector<float>& buffer)
+{
+    auto op = [](float a, float b){ return Erosion ? std::min(a,b) : std::max(a,b); };
+
+    int offset = k/2;
+    int len = ((n+k-1 + k-1)/k) * k;
+    buffer.resize(2*len*lanes);
+    float* g = buffer.data();
+    float* h = g + len*lanes;
+
+    for(int b=0;b<len;b+=k)
+    {
+        for(int j=b;j<b+k;++j)
+        {
+            const float* e = src + std::min(std::max(j-offset, 0), n-1)*stride;
+            float* gj = g + j*lanes;
+            if(j == b) for(int l=0;l<lanes;++l) gj[l] = e[l];
+            else for(int l=0;l<lanes;++l) gj[l] = op(gj[l-lanes], e[l]);
+        }
+        for(int j=b+k-1;j>=b;--j)
+        {
+            const float* e = src + std::min(std::max(j-offset, 0), n-1)*stride;
+            float* hj = h + j*lanes;
+            if(j == b+k-1) for(int l=0;l<lanes;++l) hj[l] = e[l];
+            else for(int l=0;l<lanes;++l) hj[l] = op(hj[l+lanes], e[l]);
+        }
+    }
+
+    for(int x=0;x<n;++x)
+    {
+        const float* hx = h + x*lanes;
+        const float* gx = g + (x+k-1)*lanes;
+        float* d = dst + x*stride;
+        for(int l=0;l<lanes;++l) d[l] = op(hx[l], gx[l]);
+    }
+}
+
+// --------------------------------------------------------------------------
+// rows pass then columns pass. Columns are processed by slices of pixels so that
+// the block buffers stay small and the inner loops run along rows
+template<bool Erosion>
+static void rectangleMorphology(const float* src, float* dst, float* tmp, unsigned int width, unsigned int height,
+                                unsigned int kw, unsigned int kh)
+{
+    parallelFor(0, height, [&](unsigned int y0, unsigned int y1)
+    {
+        std::vector<float> buffer;
+        for(unsigned int y=y0;y<y1;++y)
+            vanHerkGilWerman<Erosion>(src + y*width*4, tmp + y*width*4, width, 4, 4, kw, buffer);
+    });
+
+    const unsigned int slice = 64;
+    parallelFor(0, (width+slice-1)/slice, [&](unsigned int s0, unsigned int s1)
+    {
+        std::vector<float> buffer;
+        for(unsigned int s=s0;s<s1;++s)
+        {
+            unsigned int x0 = s*slice, x1 = std::min(x0+slice, width);
+            vanHerkGilWerman<Erosion>(tmp + x0*4, dst + x0*4, height, width*4, (x1-x0)*4, kh, buffer);
+        }
+    });
+}
+
+// --------------------------------------------------------------------------
+// any kernel : min/max of the source values weighted by the non-zero coefficients
+static void morphology(const float* src, float* dst, unsigned int width, unsigned int height, const Matrix& mat, bool erosion)
+{
+    int mw = mat.rowSize(), mh = mat.colSize();
+    int rx = mw/2, ry = mh/2;
+
+    parallelFor(0, height, [&](unsigned int y0, unsigned int y1)
+    {
+        for(int y=y0;y<(int)y1;++y) for(int x=0;x<(int)width;++x)
+        {
+            float acc[4];
+            for(int c=0;c<4;++c) acc[c] = erosion ? 1.0f : 0.0f;
+
+            for(int j=0;j<mh;++j) for(int i=0;i<mw;++i)
+            {
+                float coef = mat(i,j);
+                if(coef == 0.0f) continue;
+
+                int sx = std::min(std::max(x+i-rx, 0), int(width)-1);
+                int sy = std::min(std::max(y+j-ry, 0), int(height)-1);
+                const float* p = src + (sy*width+sx)*4;
+                for(int c=0;c<4;++c) acc[c] = erosion ? std::min(acc[c], p[c]*coef) : std::max(acc[c], p[c]*coef);
+            }
+
+            for(int c=0;c<4;++c) dst[(y*width+x)*4+c] = acc[c];
+        }
+    });
+}
+
 //--------------------------------------------------------------
 Morphology::Morphology(MorphType t)
     : _type(t)
+    , _rectangle(false)
+    , _backend(Filter::defaultBackend())
 {
     initialize();
 }
@@ -71,6 +183,8 @@ Morphology::Morphology(MorphType t)
 //--------------------------------------------------------------
 Morphology::Morphology(const Matrix& mat, MorphType t)
     : _type(t)
+    , _rectangle(false)
+    , _backend(Filter::defaultBackend())
 {
     initialize();
     setMatrix(mat);
@@ -85,6 +199,8 @@ Morphology::~Morphology()
 //--------------------------------------------------------------
 void Morphology::initialize()
 {
+    if(_backend != Filter::GPU) return;
+
     _area = sf::VertexBuffer(sf::Quads, sf::VertexBuffer::Static);
     _area.create(4);
 
@@ -103,38 +219,257 @@ void Morphology::cleanup()
 void Morphology::setMatrix(const Matrix& mat)
 {
     _matrix = mat;
+
+    // full rectangle of ones
+    _rectangle = _matrix.valid();
+    for(unsigned int j=0;_rectangle && j<_matrix.colSize();++j)
+        for(unsigned int i=0;i<_matrix.rowSize();++i) if(_matrix(i,j) != 1.0f) _rectangle = false;
+
+    if(_rectangle)
+    {
+        _row = Matrix(_matrix.rowSize(), 1);
+        _column = Matrix(1, _matrix.colSize());
+        for(unsigned int i=0;i<_matrix.rowSize();++i) _row(i,0) = 1.0;
+        for(unsigned int j=0;j<_matrix.colSize();++j) _column(0,j) = 1.0;
+    }
+}
+
+//--------------------------------------------------------------
+void Morphology::setBackend(Filter::Backend backend)
+{
+    bool reload = (backend == Filter::GPU && _backend != Filter::GPU);
+    _backend = backend;
+
+    // GL resources are only created for the GPU backend
+    if(reload) initialize();
+}
+
+//--------------------------------------------------------------
+void Morphology::draw(const sf::Texture& src, sf::RenderTexture& target, const Matrix& mat, int optype,
+                      int combine, const sf::Texture* ref)
+{
+    sf::Vector2f srcsize(src.getSize().x, src.getSize().y);
+    sf::Vector2f matsize(mat.rowSize(),mat.colSize());
+
+    _shader.setUniform("u_src", src);
+    _shader.setUniform("u_srcsize", srcsize);
+    _shader.setUniformArray("u_matrix", mat.data(), mat.rowSize()*mat.colSize());
+    _shader.setUniform("u_matrixsize", matsize);
+    _shader.setUniform("u_optype", optype);
+    _shader.setUniform("u_combine", combine);
+    if(ref) _shader.setUniform("u_ref", *ref);
+
+    target.draw(_area, &_shader);
 }
 
 //--------------------------------------------------------------
 const sf::Texture& Morphology::apply(const sf::Texture& src)
 {
+    if(_backend == Filter::CPU)
+    {
+        _cpuTexture.loadFromImage( apply(src.copyToImage()) );
+        return _cpuTexture;
+    }
+
     if(_target.getSize() != src.getSize()) resize(src.getSize());
 
-    if(_matrix.valid())
+    if(!_matrix.valid()) return texture();
+
+    bool separable = _rectangle && _row.rowSize() <= s_maxShaderTaps && _column.colSize() <= s_maxShaderTaps;
+    if(!separable && _matrix.rowSize()*_matrix.colSize() > s_maxShaderTaps)
     {
-        sf::Vector2f srcsize(src.getSize().x, src.getSize().y);
-        sf::Vector2f matsize(_matrix.rowSize(),_matrix.colSize());
+        // too large for the shader : CPU result copied into the target with an identity kernel
+        _cpuTexture.loadFromImage( apply(src.copyToImage()) );
 
-        _shader.setUniform("u_src", src);
-        _shader.setUniform("u_srcsize", srcsize);
-        _shader.setUniformArray("u_matrix", _matrix.data(), _matrix.size());
-        _shader.setUniform("u_matrixsize", matsize);
+        Matrix identity(1,1);
+        identity(0,0) = 1.0;
+        draw(_cpuTexture, _target, identity, 0);
+        return texture();
+    }
 
-        if(_type==Dilation) _shader.setUniform("u_optype", 0);
-        if(_type==Erosion) _shader.setUniform("u_optype", 1);
+    // operations as (first, second) elementary ones, 0 dilation, 1 erosion, -1 none.
+    // The last pass combines its result with the source (top-hats) or the first result (gradient)
+    const sf::Texture& input = src;
+    int first = (_type==Erosion || _type==Opening || _type==TopHat) ? 1 : 0;
+    int second = -1, combine = 0;
+    if(_type==Opening || _type==TopHat) second = 0;
+    if(_type==Closing || _type==BlackHat) second = 1;
+    if(_type==TopHat) combine = 1;
+    if(_type==BlackHat) combine = 2;
+
+    if(separable)
+    {
+        // rectangles : row then column passes, ping-pong between _subtarget and _target
+        if(_type==Gradient)
+        {
+            if(_reftarget.getSize() != src.getSize()) _reftarget.create(src.getSize().x, src.getSize().y);
+
+            draw(input, _subtarget, _row, 0);
+            draw(_subtarget.getTexture(), _reftarget, _column, 0);
+            draw(input, _subtarget, _row, 1);
+            draw(_subtarget.getTexture(), _target, _column, 1, 1, &_reftarget.getTexture());
+            return texture();
+        }
+
+        draw(input, _subtarget, _row, first);
+        if(second < 0)
+        {
+            draw(_subtarget.getTexture(), _target, _column, first);
+            return texture();
+        }
 
-        _target.draw(_area, &_shader);
+        draw(_subtarget.getTexture(), _target, _column, first);
+        draw(_target.getTexture(), _subtarget, _row, second);
+        draw(_subtarget.getTexture(), _target, _column, second, combine, &input);
+        return texture();
+    }
+
+    if(_type==Gradient)
+    {
+        draw(input, _subtarget, _matrix, 0);
+        draw(input, _target, _matrix, 1, 1, &_subtarget.getTexture());
+    }
+    else if(second < 0)
+    {
+        draw(input, _target, _matrix, first);
+    }
+    else
+    {
+        draw(input, _subtarget, _matrix, first);
+        draw(_subtarget.getTexture(), _target, _matrix, second, combine, &input);
     }
 
     return texture();
 }
 
+//--------------------------------------------------------------
+const sf::Image& Morphology::apply(const sf::Image& src)
+{
+    if(_matrix.valid())
+    {
+        imageToBuffer(src, _srcBuffer);
+        _dstBuffer.resize(_srcBuffer.size());
+
+        process(_srcBuffer.data(), _dstBuffer.data(), src.getSize().x, src.getSize().y);
+
+        bufferToImage(_dstBuffer, src.getSize(), _cpuImage);
+    }
+
+    return image();
+}
+
+//--------------------------------------------------------------
+const ImageBuffer<float>& Morphology::apply(const ImageBuffer<float>& src)
+{
+    if(_matrix.valid())
+    {
+        bufferToRGBA(src, _srcBuffer);
+        _dstBuffer.resize(_srcBuffer.size());
+
+        process(_srcBuffer.data(), _dstBuffer.data(), src.width(), src.height());
+
+        _cpuResult.create(src.width(), src.height(), src.channels());
+        rgbaToBuffer(_dstBuffer, _cpuResult);
+    }
+
+    return _cpuResult;
+}
+
+//--------------------------------------------------------------
+const sf::Image& Morphology::apply(const sf::Image& src, const sf::IntRect& roi)
+{
+    if(_matrix.valid())
+    {
+        sf::IntRect region = roi;
+        sf::IntRect window = apronWindow(region, apron(), src.getSize());
+
+        imageToBuffer(src, window, _srcBuffer);
+        _dstBuffer.resize(_srcBuffer.size());
+
+        if(!_srcBuffer.empty()) process(_srcBuffer.data(), _dstBuffer.data(), window.width, window.height);
+
+        bufferToImage(_dstBuffer, sf::Vector2u(window.width, window.height), region, _cpuImage);
+    }
+
+    return image();
+}
+
+//--------------------------------------------------------------
+unsigned int Morphology::apron() const
+{
+    unsigned int reach = std::max(_matrix.rowSize(), _matrix.colSize()) / 2;
+    bool twoPasses = (_type == Opening || _type == Closing || _type == TopHat || _type == BlackHat);
+    return twoPasses ? 2*reach : reach;
+}
+
+//--------------------------------------------------------------
+void Morphology::process(const float* src, float* dst, unsigned int width, unsigned int height)
+{
+    unsigned int n = width*height*4;
+
+    switch(_type)
+    {
+    case Dilation:
+    case Erosion:
+        erodeDilate(src, dst, width, height, _type==Erosion);
+        break;
+
+    case Opening:
+    case TopHat:
+        _passBuffer.resize(n);
+        erodeDilate(src, _passBuffer.data(), width, height, true);
+        erodeDilate(_passBuffer.data(), dst, width, height, false);
+        if(_type==TopHat) for(unsigned int i=0;i<n;++i) dst[i] = std::max(src[i]-dst[i], 0.0f);
+        break;
+
+    case Closing:
+    case BlackHat:
+        _passBuffer.resize(n);
+        erodeDilate(src, _passBuffer.data(), width, height, false);
+        erodeDilate(_passBuffer.data(), dst, width, height, true);
+        if(_type==BlackHat) for(unsigned int i=0;i<n;++i) dst[i] = std::max(dst[i]-src[i], 0.0f);
+        break;
+
+    case Gradient:
+        _passBuffer.resize(n);
+        erodeDilate(src, _passBuffer.data(), width, height, false);
+        erodeDilate(src, dst, width, height, true);
+        for(unsigned int i=0;i<n;++i) dst[i] = _passBuffer[i]-dst[i];
+        break;
+    }
+
+    for(unsigned int i=3;i<n;i+=4) dst[i] = 1.0f;
+}
+
+//--------------------------------------------------------------
+void Morphology::erodeDilate(const float* src, float* dst, unsigned int width, unsigned int height, bool erosion)
+{
+    if(_rectangle)
+    {
+        // about 3 comparisons per pixel and pass, whatever the rectangle size
+        _tmpBuffer.resize(width*height*4);
+        if(erosion) rectangleMorphology<true>(src, dst, _tmpBuffer.data(), width, height, _row.rowSize(), _column.colSize());
+        else rectangleMorphology<false>(src, dst, _tmpBuffer.data(), width, height, _row.rowSize(), _column.colSize());
+    }
+    else
+    {
+        morphology(src, dst, width, height, _matrix, erosion);
+    }
+}
+
 //--------------------------------------------------------------
 const sf::Texture& Morphology::texture() const
 {
+    if(_backend == Filter::CPU) return _cpuTexture;
     return _target.getTexture();
 }
 
+//--------------------------------------------------------------
+const sf::Image& Morphology::image() const
+{
+    return _cpuImage;
+}
+
 //--------------------------------------------------------------
 void Morphology::resize(const sf::Vector2u& size)
 {
@@ -177,3 +512,14 @@ Square3x3Morpho::Square3x3Morpho(MorphType t)
 
     setMatrix(kernel);
 }
+
+
+//--------------------------------------------------------------
+RectangleMorpho::RectangleMorpho(unsigned int width, unsigned int height, MorphType t)
+    : Morphology(t)
+{
+    Matrix kernel(width,height);
+    for(unsigned int j=0;j<height;++j) for(unsigned int i=0;i<width;++i) kernel(i,j) = 1.0;
+
+    setMatrix(kernel);
+}
@@ -15,8 +15,11 @@ public:
     {
         Dilation,
         Erosion,
-        Opening,
-        Closing
+        Opening,        // erosion then dilation
+        Closing,        // dilation then erosion
+        TopHat,         // source - opening
+        BlackHat,       // closing - source
+        Gradient        // dilation - erosion
     };
 
     Morphology(MorphType t = Dilation);
@@ -28,18 +31,58 @@ public:
 
     void setMatrix(const Matrix& mat);
 
+    // execution backend, the filters default one when created
+    void setBackend(Filter::Backend backend);
+    Filter::Backend backend() const {return _backend;}
+
     virtual const sf::Texture& apply(const sf::Texture& src);
 
+    // CPU path, doesn't need any GL context
+    const sf::Image& apply(const sf::Image& src);
+
+    // CPU path on a buffer of 1 to 4 channels (values in [0,1]), same layout result
+    const ImageBuffer<float>& apply(const ImageBuffer<float>& src);
+
+    // CPU path on a region of interest, like Filter : region size result, apron() read around it
+    const sf::Image& apply(const sf::Image& src, const sf::IntRect& roi);
+
+    // source pixels needed on each side of a region (twice the kernel reach for two-pass operations)
+    unsigned int apron() const;
+
+    // CPU kernel on RGBA float buffers (row-major, values in [0,1])
+    virtual void process(const float* src, float* dst, unsigned int width, unsigned int height);
+
     const sf::Texture& texture() const;
+    const sf::Image& image() const;
 
 protected:
     void resize(const sf::Vector2u& size);
 
+    // one shader pass of a (sub-)kernel, its result optionally combined with a reference
+    void draw(const sf::Texture& src, sf::RenderTexture& target, const Matrix& mat, int optype,
+              int combine = 0, const sf::Texture* ref = nullptr);
+
+    // CPU dilation or erosion
+    void erodeDilate(const float* src, float* dst, unsigned int width, unsigned int height, bool erosion);
+
     sf::RenderTexture _target, _subtarget;
+    sf::RenderTexture _reftarget;       // first result of the separable gradient
     sf::VertexBuffer _area;
     sf::Shader _shader;
     Matrix _matrix;
     MorphType _type;
+
+    // rectangles of ones are separable : a row then a column pass, van Herk/Gil-Werman on CPU
+    bool _rectangle;
+    Matrix _row, _column;
+    std::vector<float> _tmpBuffer;
+    std::vector<float> _passBuffer;     // first result of the two-pass operations (CPU)
+
+    Filter::Backend _backend;
+    sf::Texture _cpuTexture;
+    sf::Image _cpuImage;
+    ImageBuffer<float> _cpuResult;
+    std::vector<float> _srcBuffer, _dstBuffer;
 };
 
 //--------------------------------------------------------------
@@ -54,4 +97,11 @@ struct Square3x3Morpho : public Morphology
     Square3x3Morpho(MorphType t = Dilation);
 };
 
+//--------------------------------------------------------------
+// width x height rectangle (lines when one of them is 1), any size
+struct RectangleMorpho : public Morphology
+{
+    RectangleMorpho(unsigned int width, unsigned int height, MorphType t = Dilation);
+};
+
 #endif // MORPHOLOGY_HPP
@@ -0,0 +1,150 @@
+#include "otsuThreshold.hpp"
+
+#include "cpuBackend.hpp"
+#include "posterization.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// --------------------------------------------------------------------------
+OtsuThreshold::OtsuThreshold()
+{
+    initialize();
+}
+
+// --------------------------------------------------------------------------
+OtsuThreshold::~OtsuThreshold()
+{
+    cleanup();
+}
+
+// --------------------------------------------------------------------------
+void OtsuThreshold::initialize()
+{
+}
+
+// --------------------------------------------------------------------------
+void OtsuThreshold::cleanup()
+{
+}
+
+// --------------------------------------------------------------------------
+std::vector<int> OtsuThreshold::compute(const std::vector<int>& histogram, int K)
+{
+    const int L = 256;
+    K = std::max(2, std::min(K, L));
+
+    // prefix sums : count and level sum of the levels [0,i)
+    std::vector<double> P(L+1, 0.0), S(L+1, 0.0);
+    for(int i=0;i<L;++i)
+    {
+        P[i+1] = P[i] + histogram[i];
+        S[i+1] = S[i] + double(histogram[i]) * i;
+    }
+
+    // between-class variance (up to constants) of the class [a,b)
+    auto score = [&](int a, int b)
+    {
+        double w = P[b]-P[a];
+        return w > 0.0 ? (S[b]-S[a])*(S[b]-S[a]) / w : 0.0;
+    };
+
+    // best[k][i] : best score splitting the levels [0,i) in k+1 classes, O(K*L^2)
+    std::vector<double> best(K*(L+1), -1.0);
+    std::vector<int> split(K*(L+1), 0);
+    for(int i=1;i<=L;++i) best[i] = score(0,i);
+
+    for(int k=1;k<K;++k)
+    {
+        for(int i=k+1;i<=L;++i)
+        {
+            double& b = best[k*(L+1)+i];
+            for(int j=k;j<i;++j)
+            {
+                double v = best[(k-1)*(L+1)+j] + score(j,i);
+                if(v > b) { b = v; split[k*(L+1)+i] = j; }
+            }
+        }
+    }
+
+    // back-tracking the class starts
+    std::vector<int> thresholds(K-1);
+    int i = L;
+    for(int k=K-1;k>0;--k)
+    {
+        i = split[k*(L+1)+i];
+        thresholds[k-1] = i-1;
+    }
+    return thresholds;
+}
+
+// --------------------------------------------------------------------------
+void OtsuThreshold::levels(const ImageBuffer<sf::Uint8>& input, int K, sf::Uint8* lut)
+{
+    std::vector<int> hist = histo(input);
+    m_thresholds = compute(hist, K);
+    K = m_thresholds.size()+1;
+
+    // class levels : mean of the class (middle of the range when empty)
+    m_levels.resize(K);
+    for(int k=0, t=0;k<K;++k)
+    {
+        int last = (k < K-1) ? m_thresholds[k] : 255;
+        double n = 0.0, sum = 0.0;
+        for(int v=t;v<=last;++v) { n += hist[v]; sum += double(hist[v]) * v; }
+
+        m_levels[k] = n > 0.0 ? int(std::lround(sum/n)) : (t+last)/2;
+        for(int v=t;v<=last;++v) lut[v] = m_levels[k];
+        t = last+1;
+    }
+}
+
+// --------------------------------------------------------------------------
+const sf::Image& OtsuThreshold::apply(const sf::Image& input, int K)
+{
+    sf::Vector2u size = input.getSize();
+    sf::Uint8 lut[256];
+    levels(imageView(input), K, lut);
+
+    // generate result
+    const sf::Uint8* src = input.getPixelsPtr();
+    std::vector<sf::Uint8> dst(size.x*size.y*4);
+    parallelFor(0, size.y, [&](unsigned int y0, unsigned int y1)
+    {
+        for(unsigned int i=y0*size.x;i<y1*size.x;++i)
+        {
+            sf::Uint8 c = lut[ src[i*4] ];
+            dst[i*4] = c; dst[i*4+1] = c; dst[i*4+2] = c; dst[i*4+3] = 255;
+        }
+    });
+    m_target.create(size.x, size.y, dst.data());
+
+    return m_target;
+}
+
+// --------------------------------------------------------------------------
+const ImageBuffer<sf::Uint8>& OtsuThreshold::apply(const ImageBuffer<sf::Uint8>& input, int K)
+{
+    sf::Uint8 lut[256];
+    levels(input, K, lut);
+
+    unsigned int w = input.width(), ch = input.channels();
+    m_buffer.create(w, input.height(), 1);
+    parallelFor(0, input.height(), [&](unsigned int y0, unsigned int y1)
+    {
+        for(unsigned int y=y0;y<y1;++y)
+        {
+            const sf::Uint8* src = input.row(y);
+            sf::Uint8* dst = m_buffer.row(y);
+            for(unsigned int x=0;x<w;++x) dst[x] = lut[ src[x*ch] ];
+        }
+    });
+
+    return m_buffer;
+}
+
+// --------------------------------------------------------------------------
+const sf::Image& OtsuThreshold::getResultAsImage()
+{
+    return m_target;
+}
@@ -0,0 +1,51 @@
+#ifndef OTSU_THRESHOLD_HPP
+#define OTSU_THRESHOLD_HPP
+
+#include <SFML/Graphics.hpp>
+
+#include "imageBuffer.hpp"
+
+// --------------------------------------------------------------------------
+// Helper class - multi-level Otsu thresholding : the K-1 thresholds maximizing the
+// between-class variance of the red channel histogram, exact search without iteration.
+// An alternative to the K-means posterization with a bounded cost.
+class OtsuThreshold
+{
+public:
+    OtsuThreshold();
+    virtual ~OtsuThreshold();
+
+    void initialize();
+    void cleanup();
+
+    // compute a K levels image (K from 2 to 256) : pixels of a class take its mean level
+    const sf::Image& apply( const sf::Image& image, int K = 2 );
+
+    // same on the first channel of a buffer, single channel result
+    const ImageBuffer<sf::Uint8>& apply( const ImageBuffer<sf::Uint8>& input, int K = 2 );
+
+    // thresholds of a 256 bins histogram : class k holds the levels t with
+    // thresholds[k-1] < t <= thresholds[k] (K-1 values)
+    static std::vector<int> compute( const std::vector<int>& histogram, int K );
+
+    // thresholds and class levels of the last image
+    const std::vector<int>& getThresholds() const {return m_thresholds;}
+    const std::vector<int>& getLevels() const {return m_levels;}
+
+    // get result image
+    const sf::Image& getResultAsImage();
+
+    // get result buffer (buffer path)
+    const ImageBuffer<sf::Uint8>& getResultAsBuffer() const {return m_buffer;}
+
+protected:
+    // thresholds, class levels and level of each of the 256 input levels
+    void levels(const ImageBuffer<sf::Uint8>& input, int K, sf::Uint8* lut);
+
+    sf::Image m_target;                 // result image
+    ImageBuffer<sf::Uint8> m_buffer;    // buffer path result
+    std::vector<int> m_thresholds;
+    std::vector<int> m_levels;
+};
+
+#endif // OTSU_THRESHOLD_HPP
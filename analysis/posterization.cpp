@@ -1,24 +1,26 @@
 #include "posterization.hpp"
 
-#include <iostream>
+#include "cpuBackend.hpp"
+#include "histogram.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <random>
 
 // --------------------------------------------------------------------------
 std::vector<int> histo(const sf::Image& img)
 {
-    std::vector<int> hist(255,0);
-    for(int x=0;x<(int)img.getSize().x;++x) for(int y=0;y<(int)img.getSize().y;++y)
-    {
-        hist[ img.getPixel(x,y).r ]++;
-    }
-
-    // for(int i=0;i<255;++i)
-    // {
-    //     float v = float(hist[i]) / float(img.getSize().x*img.getSize().y);
-    //     for(int k=0;k<v*100.0;++k) std::cout << ".";
-    //     std::cout << std::endl;
-    // }
-
+    return histo(imageView(img));
+}
 
+// --------------------------------------------------------------------------
+std::vector<int> histo(const ImageBuffer<sf::Uint8>& img)
+{
+    Histogram histogram;
+    histogram.compute(img, 1);
+    std::vector<int> hist(histogram.bins(0).begin(), histogram.bins(0).end());
     return hist;
 }
 
@@ -45,9 +47,11 @@ std::vector<int> maxima(const std::vector<int>& h)
     int m1 = meanAt(h,0);
     int m2 = 0;
 
-    for(int i=0;i<255;++i)
+    // every bin, the last one included (nothing above it)
+    int n = h.size();
+    for(int i=0;i<n;++i)
     {
-        m2 = meanAt(h,i+1);
+        m2 = (i+1 < n) ? meanAt(h,i+1) : 0;
 
         if(m1>m0 && m1>m2)
         {
@@ -76,6 +80,111 @@ std::vector<int> maxima(const std::vector<int>& h)
     return maxs;
 }
 
+// --------------------------------------------------------------------------
+// color histogram : 5 bits per channel, bin mean colors kept for the k-means
+static const int s_colorBits = 5;
+static const int s_colorBins = 1 << (3*s_colorBits);
+
+static inline int colorBin(const sf::Uint8* px)
+{
+    const int shift = 8-s_colorBits;
+    return ((px[0]>>shift) << (2*s_colorBits)) | ((px[1]>>shift) << s_colorBits) | (px[2]>>shift);
+}
+
+// row as RGB : gray rows (1 or 2 channels) are expanded in a scratch row
+static const sf::Uint8* colorRow(const sf::Uint8* src, unsigned int w, unsigned int ch, std::vector<sf::Uint8>& rgb)
+{
+    if(ch >= 3) return src;
+    rgb.resize(w*3);
+    for(unsigned int x=0;x<w;++x) rgb[x*3] = rgb[x*3+1] = rgb[x*3+2] = src[x*ch];
+    return rgb.data();
+}
+
+struct ColorSample
+{
+    float r, g, b;
+    float weight;
+};
+
+// --------------------------------------------------------------------------
+static std::vector<ColorSample> colorHisto(const ImageBuffer<sf::Uint8>& img, std::vector<int>& binSample)
+{
+    unsigned int w = img.width(), ch = img.channels();
+    unsigned int step = std::max(ch, 3u);
+
+    std::vector<unsigned long long> hist(s_colorBins*4, 0);  // count, sum r, sum g, sum b
+    std::mutex histMutex;
+    parallelFor(0, img.height(), [&](unsigned int y0, unsigned int y1)
+    {
+        std::vector<unsigned long long> local(s_colorBins*4, 0);
+        std::vector<sf::Uint8> rgb;
+        for(unsigned int y=y0;y<y1;++y)
+        {
+            const sf::Uint8* px = colorRow(img.row(y), w, ch, rgb);
+            for(unsigned int x=0;x<w;++x,px+=step)
+            {
+                unsigned long long* bin = &local[colorBin(px)*4];
+                bin[0]++; bin[1] += px[0]; bin[2] += px[1]; bin[3] += px[2];
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(histMutex);
+        for(int i=0;i<s_colorBins*4;++i) hist[i] += local[i];
+    });
+
+    std::vector<ColorSample> samples;
+    binSample.assign(s_colorBins, -1);
+    for(int i=0;i<s_colorBins;++i)
+    {
+        const unsigned long long* bin = &hist[i*4];
+        if(bin[0] == 0) continue;
+
+        double n = bin[0];
+        ColorSample c = { float(bin[1]/n), float(bin[2]/n), float(bin[3]/n), float(n) };
+        binSample[i] = samples.size();
+        samples.push_back(c);
+    }
+
+    return samples;
+}
+
+// --------------------------------------------------------------------------
+static inline float colorDistance(const ColorSample& a, const ColorSample& b)
+{
+    float dr = a.r-b.r, dg = a.g-b.g, db = a.b-b.b;
+    return dr*dr + dg*dg + db*db;
+}
+
+// --------------------------------------------------------------------------
+static int closestColor(const ColorSample& c, const std::vector<ColorSample>& centers)
+{
+    int best = 0;
+    float bd = colorDistance(c, centers[0]);
+    for(int k=1;k<(int)centers.size();++k)
+    {
+        float d = colorDistance(c, centers[k]);
+        if(d < bd) { bd = d; best = k; }
+    }
+    return best;
+}
+
+// --------------------------------------------------------------------------
+// closest and second closest centers (distances, not squared)
+static int closestColor(const ColorSample& c, const std::vector<ColorSample>& centers, float& first, float& second)
+{
+    int best = 0;
+    float d0 = 1e30f, d1 = 1e30f;
+    for(int k=0;k<(int)centers.size();++k)
+    {
+        float d = colorDistance(c, centers[k]);
+        if(d < d0) { d1 = d0; d0 = d; best = k; }
+        else if(d < d1) d1 = d;
+    }
+    first = std::sqrt(d0);
+    second = std::sqrt(d1);
+    return best;
+}
+
 // --------------------------------------------------------------------------
 Posterization::Posterization()
 {
@@ -105,55 +214,48 @@ void Posterization::resizeRenderTarget(const sf::Vector2u& size)
 }
 
 // --------------------------------------------------------------------------
-const sf::Image& Posterization::apply(const sf::Image &input, int K)
+void Posterization::levels(const ImageBuffer<sf::Uint8>& input, int K, sf::Uint8* lut)
 {
     std::vector<int> hist = histo(input);
     std::vector<int> mxs = maxima( hist );
-    std::cout << std::endl;
 
     K = std::min((int)mxs.size(),K);
 
-    std::srand(time(NULL));
-
-    sf::Vector2u currSize = m_target.getSize();
-    sf::Vector2u size = input.getSize();
-    if(currSize != size)
+    // no histogram peak (empty image, flat histogram) : levels kept
+    if(K <= 0)
     {
-        resizeRenderTarget(size);
-        currSize = size;
+        for(int v=0;v<256;++v) lut[v] = v;
+        return;
     }
 
     std::vector<int> k_colors(K);
-    std::vector<int> k_next(K);
-    std::vector<int> k_npx(K);
+    std::vector<long long> k_next(K);
+    std::vector<long long> k_npx(K);
 
     // init
     for(int i=0;i<K;++i) k_colors[i] = mxs[i];
 
     int last_shift_max = 1000;
-    int ite = 0;
 
     while(last_shift_max > 0)
     {
-        ite++;
         for(int k=0;k<K;++k) { k_next[k]=0; k_npx[k]=0; }
 
-        // scan pixels and associate it to closest mean
-        for(int x=0;x<(int)size.x;++x) for(int y=0;y<(int)size.y;++y)
+        // scan histogram levels and associate them to closest mean
+        for(int v=0;v<256;++v)
         {
-            sf::Color px = input.getPixel(x,y);
+            if(hist[v]==0) continue;
 
             // find closest mean
             int cd = 1000;
             int b = 0;
-            int cc = 0;
             for(int k=0;k<K;++k)
             {
-                int d = std::abs(k_colors[k] - px.r);
-                if(d < cd) { b=k; cd=d; cc=px.r; }
+                int d = std::abs(k_colors[k] - v);
+                if(d < cd) { b=k; cd=d; }
             }
-            k_next[b] += cc;
-            k_npx[b]++;
+            k_next[b] += (long long)hist[v] * v;
+            k_npx[b] += hist[v];
         }
 
         // update means
@@ -166,30 +268,233 @@ const sf::Image& Posterization::apply(const sf::Image &input, int K)
             last_shift_max = std::max(last_shift_max, std::abs(last_color-k_colors[k]));
         }
     }
-    // std::cout << "k-mean convergenced in " << ite << " iterations" << std::endl;
+
+    // closest mean of each level
+    for(int v=0;v<256;++v)
+    {
+        int cd = 1000;
+        int b = v;
+        for(int k=0;k<K;++k)
+        {
+            int d = std::abs(k_colors[k] - v);
+            if(d < cd) { b=k_colors[k]; cd=d; }
+        }
+        lut[v] = b;
+    }
+}
+
+// --------------------------------------------------------------------------
+const sf::Image& Posterization::apply(const sf::Image &input, int K)
+{
+    sf::Vector2u size = input.getSize();
+    sf::Uint8 lut[256];
+    levels(imageView(input), K, lut);
 
     // generate result
-    for(int x=0;x<(int)size.x;++x) for(int y=0;y<(int)size.y;++y)
+    const sf::Uint8* src = input.getPixelsPtr();
+    std::vector<sf::Uint8> dst(size.x*size.y*4);
+    parallelFor(0, size.y, [&](unsigned int y0, unsigned int y1)
     {
-        sf::Color px = input.getPixel(x,y);
+        for(unsigned int i=y0*size.x;i<y1*size.x;++i)
+        {
+            sf::Uint8 c = lut[ src[i*4] ];
+            dst[i*4] = c; dst[i*4+1] = c; dst[i*4+2] = c; dst[i*4+3] = 255;
+        }
+    });
+    m_target.create(size.x, size.y, dst.data());
+
+
+    return m_target;
+}
+
+// --------------------------------------------------------------------------
+const ImageBuffer<sf::Uint8>& Posterization::apply(const ImageBuffer<sf::Uint8>& input, int K)
+{
+    sf::Uint8 lut[256];
+    levels(input, K, lut);
+
+    unsigned int w = input.width(), ch = input.channels();
+    m_buffer.create(w, input.height(), 1);
+    parallelFor(0, input.height(), [&](unsigned int y0, unsigned int y1)
+    {
+        for(unsigned int y=y0;y<y1;++y)
+        {
+            const sf::Uint8* src = input.row(y);
+            sf::Uint8* dst = m_buffer.row(y);
+            for(unsigned int x=0;x<w;++x) dst[x] = lut[ src[x*ch] ];
+        }
+    });
+
+    return m_buffer;
+}
+
+// --------------------------------------------------------------------------
+bool Posterization::palette(const ImageBuffer<sf::Uint8>& input, int K, std::vector<sf::Uint8>& inverse)
+{
+    std::vector<int> binSample;
+    std::vector<ColorSample> samples = colorHisto(input, binSample);
+
+    K = std::max(1, std::min(std::min(K, 256), (int)samples.size()));
+    if(samples.empty()) { m_palette.clear(); m_indices.clear(); return false; }
+
+    // k-means++ seeding on the weighted samples, fixed seed for reproducible palettes
+    std::mt19937 rng(0);
+    std::vector<ColorSample> centers;
+    std::vector<float> dist(samples.size());
+    std::vector<double> prob(samples.size());
+
+    for(unsigned int i=0;i<samples.size();++i) prob[i] = samples[i].weight;
+    while((int)centers.size() < K)
+    {
+        std::discrete_distribution<int> pick(prob.begin(), prob.end());
+        centers.push_back(samples[pick(rng)]);
+
+        double total = 0.0;
+        for(unsigned int i=0;i<samples.size();++i)
+        {
+            float d = colorDistance(samples[i], centers.back());
+            dist[i] = centers.size()==1 ? d : std::min(dist[i], d);
+            prob[i] = double(dist[i]) * samples[i].weight;
+            total += prob[i];
+        }
+        if(total == 0.0) break;     // fewer distinct colors than K
+    }
+    K = centers.size();
+
+    // Lloyd iterations on the histogram samples, with Hamerly bounds : a sample keeps its
+    // center while the distance to it (upper bound) is below both the distance to any other
+    // center (lower bound) and half the distance from its center to the closest other one
+    std::vector<int> assignment(samples.size());
+    std::vector<float> upper(samples.size()), lower(samples.size());
+    for(unsigned int i=0;i<samples.size();++i) assignment[i] = closestColor(samples[i], centers, upper[i], lower[i]);
+
+    std::vector<double> acc(K*4);
+    std::vector<float> half(K), drift(K);
+    for(int ite=0;ite<100;++ite)
+    {
+        std::fill(acc.begin(), acc.end(), 0.0);
+        for(unsigned int i=0;i<samples.size();++i)
+        {
+            double* a = &acc[assignment[i]*4];
+            a[0] += samples[i].weight;
+            a[1] += samples[i].r * samples[i].weight;
+            a[2] += samples[i].g * samples[i].weight;
+            a[3] += samples[i].b * samples[i].weight;
+        }
+
+        float maxDrift = 0.f;
+        for(int k=0;k<K;++k)
+        {
+            const double* a = &acc[k*4];
+            drift[k] = 0.f;
+            if(a[0] == 0.0) continue;   // empty cluster keeps its center
+
+            ColorSample prev = centers[k];
+            centers[k].r = a[1]/a[0]; centers[k].g = a[2]/a[0]; centers[k].b = a[3]/a[0];
+            drift[k] = std::sqrt(colorDistance(prev, centers[k]));
+            maxDrift = std::max(maxDrift, drift[k]);
+        }
+        if(maxDrift == 0.f) break;
 
-        // find closest mean
-        int cd = 1000;
-        int b = 0;
         for(int k=0;k<K;++k)
         {
-            int d = std::abs(k_colors[k] - px.r);
-            if(d < cd) { b=k; cd=d; }
+            float d = 1e30f;
+            for(int j=0;j<K;++j) if(j != k) d = std::min(d, colorDistance(centers[k], centers[j]));
+            half[k] = 0.5f * std::sqrt(d);
         }
 
-        px = sf::Color(k_colors[b],k_colors[b],k_colors[b]);
-        m_target.setPixel(x,y,px);
+        std::atomic<bool> changed(false);
+        parallelFor(0, samples.size(), [&](unsigned int i0, unsigned int i1)
+        {
+            for(unsigned int i=i0;i<i1;++i)
+            {
+                int a = assignment[i];
+                upper[i] += drift[a];
+                lower[i] -= maxDrift;
+
+                float bound = std::max(half[a], lower[i]);
+                if(upper[i] <= bound) continue;
+                upper[i] = std::sqrt(colorDistance(samples[i], centers[a]));
+                if(upper[i] <= bound) continue;
+
+                int b = closestColor(samples[i], centers, upper[i], lower[i]);
+                if(b != a) { assignment[i] = b; changed = true; }
+            }
+        });
+        if(!changed) break;
     }
 
+    m_palette.resize(K);
+    for(int k=0;k<K;++k)
+        m_palette[k] = sf::Color(std::lround(centers[k].r), std::lround(centers[k].g), std::lround(centers[k].b));
+
+    // inverse colormap : palette entry of every used histogram bin
+    inverse.assign(s_colorBins, 0);
+    for(int i=0;i<s_colorBins;++i)
+        if(binSample[i] >= 0) inverse[i] = closestColor(samples[binSample[i]], centers);
+
+    return true;
+}
+
+// --------------------------------------------------------------------------
+const sf::Image& Posterization::applyColor(const sf::Image& input, int K)
+{
+    sf::Vector2u size = input.getSize();
+    std::vector<sf::Uint8> inverse;
+    if(!palette(imageView(input), K, inverse)) { resizeRenderTarget(size); return m_target; }
+
+    // assignment pass
+    const sf::Uint8* src = input.getPixelsPtr();
+    std::vector<sf::Uint8> dst(size.x*size.y*4);
+    m_indices.resize(size.x*size.y);
+    parallelFor(0, size.y, [&](unsigned int y0, unsigned int y1)
+    {
+        for(unsigned int i=y0*size.x;i<y1*size.x;++i)
+        {
+            sf::Uint8 k = inverse[ colorBin(src+i*4) ];
+            const sf::Color& c = m_palette[k];
+            m_indices[i] = k;
+            dst[i*4] = c.r; dst[i*4+1] = c.g; dst[i*4+2] = c.b; dst[i*4+3] = src[i*4+3];
+        }
+    });
+    m_target.create(size.x, size.y, dst.data());
 
     return m_target;
 }
 
+// --------------------------------------------------------------------------
+const ImageBuffer<sf::Uint8>& Posterization::applyColor(const ImageBuffer<sf::Uint8>& input, int K)
+{
+    unsigned int w = input.width(), h = input.height(), ch = input.channels();
+    std::vector<sf::Uint8> inverse;
+    m_buffer.create(w, h, ch);
+    if(!palette(input, K, inverse)) return m_buffer;
+
+    // assignment pass, alpha kept
+    unsigned int step = std::max(ch, 3u);
+    m_indices.resize(w*h);
+    parallelFor(0, h, [&](unsigned int y0, unsigned int y1)
+    {
+        std::vector<sf::Uint8> rgb;
+        for(unsigned int y=y0;y<y1;++y)
+        {
+            const sf::Uint8* src = input.row(y);
+            const sf::Uint8* color = colorRow(src, w, ch, rgb);
+            sf::Uint8* dst = m_buffer.row(y);
+            for(unsigned int x=0;x<w;++x,src+=ch,color+=step,dst+=ch)
+            {
+                sf::Uint8 k = inverse[ colorBin(color) ];
+                const sf::Color& c = m_palette[k];
+                m_indices[y*w+x] = k;
+                if(ch >= 3) { dst[0] = c.r; dst[1] = c.g; dst[2] = c.b; } else dst[0] = c.r;
+                if(ch == 4 || ch == 2) dst[ch-1] = src[ch-1];
+            }
+        }
+    });
+
+    return m_buffer;
+}
+
 // --------------------------------------------------------------------------
 const sf::Image& Posterization::getResultAsImage()
 {
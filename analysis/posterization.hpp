@@ -3,6 +3,13 @@
 
 #include <SFML/Graphics.hpp>
 
+#include "imageBuffer.hpp"
+
+// --------------------------------------------------------------------------
+// 256 bins histogram of the red channel (first channel of a buffer)
+std::vector<int> histo(const sf::Image& img);
+std::vector<int> histo(const ImageBuffer<sf::Uint8>& img);
+
 // --------------------------------------------------------------------------
 // Helper class - give functions for posterization using K-means algorithm
 class Posterization
@@ -17,15 +24,42 @@ public:
     // compute a posterized image from a input and a K parameter
     const sf::Image& apply( const sf::Image& texture, int K = 255 );
 
+    // same on the first channel of a buffer, single channel result
+    const ImageBuffer<sf::Uint8>& apply( const ImageBuffer<sf::Uint8>& input, int K = 255 );
+
+    // color posterization into K colors (at most 256) : k-means on a 5 bits per channel
+    // histogram seeded with k-means++, pixels mapped through an inverse colormap
+    const sf::Image& applyColor( const sf::Image& image, int K = 16 );
+
+    // same on a RGB or RGBA buffer, result with the same channels. Gray buffers (with or
+    // without alpha) are taken as RGB and keep their layout
+    const ImageBuffer<sf::Uint8>& applyColor( const ImageBuffer<sf::Uint8>& input, int K = 16 );
+
+    // palette and palette index of each pixel (row-major) of the last color posterization
+    const std::vector<sf::Color>& getPalette() const {return m_palette;}
+    const std::vector<sf::Uint8>& getIndices() const {return m_indices;}
+
     // get result texture
     const sf::Image& getResultAsImage();
 
+    // get result buffer (buffer paths)
+    const ImageBuffer<sf::Uint8>& getResultAsBuffer() const {return m_buffer;}
+
 protected:
 
+    // level of each of the 256 input levels (K-means on the first channel histogram)
+    void levels(const ImageBuffer<sf::Uint8>& input, int K, sf::Uint8* lut);
+
+    // palette and palette entry of each color histogram bin, false without pixels
+    bool palette(const ImageBuffer<sf::Uint8>& input, int K, std::vector<sf::Uint8>& inverse);
+
     // resize render target
     void resizeRenderTarget(const sf::Vector2u& size);
 
     sf::Image m_target;         // target renderTexture
+    std::vector<sf::Color> m_palette;
+    std::vector<sf::Uint8> m_indices;
+    ImageBuffer<sf::Uint8> m_buffer;    // buffer paths result
 };
 
 #endif // POSTERIZATION_HPP
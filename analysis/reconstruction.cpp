@@ -0,0 +1,279 @@
+#include "reconstruction.hpp"
+
+#include "cpuBackend.hpp"
+
+#include <algorithm>
+
+// --------------------------------------------------------------------------
+Reconstruction::Reconstruction()
+    : m_connectivity(Eight)
+{
+    initialize();
+}
+
+// --------------------------------------------------------------------------
+Reconstruction::~Reconstruction()
+{
+    cleanup();
+}
+
+// --------------------------------------------------------------------------
+void Reconstruction::initialize()
+{
+}
+
+// --------------------------------------------------------------------------
+void Reconstruction::cleanup()
+{
+    m_queue.clear();
+}
+
+// --------------------------------------------------------------------------
+void Reconstruction::setConnectivity(Connectivity connectivity)
+{
+    m_connectivity = connectivity;
+}
+
+// --------------------------------------------------------------------------
+void Reconstruction::extract(const ImageBuffer<sf::Uint8>& buffer, std::vector<sf::Uint8>& values)
+{
+    unsigned int w = buffer.width(), ch = buffer.channels();
+    values.resize(w*buffer.height());
+    parallelFor(0, buffer.height(), [&](unsigned int y0, unsigned int y1)
+    {
+        for(unsigned int y=y0;y<y1;++y)
+        {
+            const sf::Uint8* px = buffer.row(y);
+            for(unsigned int x=0;x<w;++x) values[y*w+x] = px[x*ch];
+        }
+    });
+}
+
+// --------------------------------------------------------------------------
+void Reconstruction::updateImage(const sf::Vector2u& size)
+{
+    std::vector<sf::Uint8> pixels(size.x*size.y*4);
+    parallelFor(0, size.y, [&](unsigned int y0, unsigned int y1)
+    {
+        for(unsigned int i=y0*size.x;i<y1*size.x;++i)
+        {
+            sf::Uint8 v = m_marker[i];
+            pixels[i*4] = v; pixels[i*4+1] = v; pixels[i*4+2] = v; pixels[i*4+3] = 255;
+        }
+    });
+    m_image.create(size.x, size.y, pixels.data());
+}
+
+// --------------------------------------------------------------------------
+void Reconstruction::borderMarker(const std::vector<sf::Uint8>& image, unsigned int width, unsigned int height)
+{
+    m_marker.assign(width*height, 0);
+    for(unsigned int x=0;x<width;++x)
+    {
+        m_marker[x] = image[x];
+        m_marker[(height-1)*width+x] = image[(height-1)*width+x];
+    }
+    for(unsigned int y=0;y<height;++y)
+    {
+        m_marker[y*width] = image[y*width];
+        m_marker[y*width+width-1] = image[y*width+width-1];
+    }
+}
+
+// --------------------------------------------------------------------------
+void Reconstruction::process(std::vector<sf::Uint8>& marker, const std::vector<sf::Uint8>& mask,
+                             unsigned int width, unsigned int height, Morphology::MorphType t)
+{
+    if(width == 0 || height == 0) return;
+    if(marker.size() != width*height || mask.size() != width*height) return;
+    if(t != Morphology::Dilation && t != Morphology::Erosion) return;
+
+    // by erosion = complement of the reconstruction by dilation of the complements
+    const bool erosion = (t == Morphology::Erosion);
+    const std::vector<sf::Uint8>* bound = &mask;
+    if(erosion)
+    {
+        m_mask.resize(mask.size());
+        for(unsigned int i=0;i<mask.size();++i) { m_mask[i] = 255-mask[i]; marker[i] = 255-marker[i]; }
+        bound = &m_mask;
+    }
+
+    sf::Uint8* J = marker.data();
+    const sf::Uint8* I = bound->data();
+    const int w = width, h = height;
+    const bool eight = (m_connectivity == Eight);
+
+    // raster scan : causal neighbors (left and row above)
+    for(int y=0;y<h;++y) for(int x=0;x<w;++x)
+    {
+        int p = y*w+x;
+        sf::Uint8 v = J[p];
+        if(x>0) v = std::max(v, J[p-1]);
+        if(y>0)
+        {
+            v = std::max(v, J[p-w]);
+            if(eight && x>0) v = std::max(v, J[p-w-1]);
+            if(eight && x<w-1) v = std::max(v, J[p-w+1]);
+        }
+        J[p] = std::min(v, I[p]);
+    }
+
+    // anti-raster scan : anti-causal neighbors, pixels which could still
+    // propagate to one of them are queued
+    m_queue.clear();
+    for(int y=h-1;y>=0;--y) for(int x=w-1;x>=0;--x)
+    {
+        int p = y*w+x;
+        int n[4], count = 0;
+        if(x<w-1) n[count++] = p+1;
+        if(y<h-1)
+        {
+            n[count++] = p+w;
+            if(eight && x<w-1) n[count++] = p+w+1;
+            if(eight && x>0) n[count++] = p+w-1;
+        }
+
+        sf::Uint8 v = J[p];
+        for(int i=0;i<count;++i) v = std::max(v, J[n[i]]);
+        v = std::min(v, I[p]);
+        J[p] = v;
+
+        for(int i=0;i<count;++i)
+        {
+            int q = n[i];
+            if(J[q] < v && J[q] < I[q]) { m_queue.push_back(p); break; }
+        }
+    }
+
+    // FIFO propagation
+    while(!m_queue.empty())
+    {
+        int p = m_queue.front();
+        m_queue.pop_front();
+        int x = p%w, y = p/w;
+
+        for(int dy=-1;dy<=1;++dy) for(int dx=-1;dx<=1;++dx)
+        {
+            if((dx==0 && dy==0) || (!eight && dx!=0 && dy!=0)) continue;
+            if(x+dx<0 || x+dx>=w || y+dy<0 || y+dy>=h) continue;
+
+            int q = p + dy*w + dx;
+            if(J[q] < J[p] && J[q] != I[q])
+            {
+                J[q] = std::min(J[p], I[q]);
+                m_queue.push_back(q);
+            }
+        }
+    }
+
+    if(erosion) for(sf::Uint8& v : marker) v = 255-v;
+}
+
+// --------------------------------------------------------------------------
+bool Reconstruction::reconstruct(const ImageBuffer<sf::Uint8>& marker, const ImageBuffer<sf::Uint8>& mask, Morphology::MorphType t)
+{
+    if(marker.size() != mask.size() || (t != Morphology::Dilation && t != Morphology::Erosion))
+    {
+        m_marker.clear();
+        return false;
+    }
+
+    extract(marker, m_marker);
+    std::vector<sf::Uint8> bound;
+    extract(mask, bound);
+    process(m_marker, bound, mask.width(), mask.height(), t);
+    return true;
+}
+
+// --------------------------------------------------------------------------
+void Reconstruction::reconstructHoles(const ImageBuffer<sf::Uint8>& image)
+{
+    // complement reconstructed from its border : what is not reached is a hole
+    sf::Vector2u size = image.size();
+    std::vector<sf::Uint8> inverse;
+    extract(image, inverse);
+    for(sf::Uint8& v : inverse) v = 255-v;
+
+    if(size.x > 0 && size.y > 0)
+    {
+        borderMarker(inverse, size.x, size.y);
+        process(m_marker, inverse, size.x, size.y, Morphology::Dilation);
+    }
+    else m_marker.clear();
+
+    for(sf::Uint8& v : m_marker) v = 255-v;
+}
+
+// --------------------------------------------------------------------------
+void Reconstruction::reconstructBorder(const ImageBuffer<sf::Uint8>& image)
+{
+    // image minus its reconstruction from the border
+    sf::Vector2u size = image.size();
+    std::vector<sf::Uint8> values;
+    extract(image, values);
+
+    if(size.x > 0 && size.y > 0)
+    {
+        borderMarker(values, size.x, size.y);
+        process(m_marker, values, size.x, size.y, Morphology::Dilation);
+    }
+    else m_marker.clear();
+
+    for(unsigned int i=0;i<values.size();++i) m_marker[i] = values[i] - m_marker[i];
+}
+
+// --------------------------------------------------------------------------
+const sf::Image& Reconstruction::apply(const sf::Image& marker, const sf::Image& mask, Morphology::MorphType t)
+{
+    bool valid = reconstruct(imageView(marker), imageView(mask), t);
+    updateImage(valid ? mask.getSize() : sf::Vector2u(0, 0));
+    return m_image;
+}
+
+// --------------------------------------------------------------------------
+const sf::Image& Reconstruction::fillHoles(const sf::Image& image)
+{
+    reconstructHoles(imageView(image));
+    updateImage(image.getSize());
+    return m_image;
+}
+
+// --------------------------------------------------------------------------
+const sf::Image& Reconstruction::clearBorder(const sf::Image& image)
+{
+    reconstructBorder(imageView(image));
+    updateImage(image.getSize());
+    return m_image;
+}
+
+// --------------------------------------------------------------------------
+const ImageBuffer<sf::Uint8>& Reconstruction::apply(const ImageBuffer<sf::Uint8>& marker, const ImageBuffer<sf::Uint8>& mask, Morphology::MorphType t)
+{
+    if(reconstruct(marker, mask, t))
+        m_buffer = ImageBuffer<sf::Uint8>(m_marker.data(), mask.width(), mask.height(), 1, mask.width());
+    else
+        m_buffer = ImageBuffer<sf::Uint8>();
+    return m_buffer;
+}
+
+// --------------------------------------------------------------------------
+const ImageBuffer<sf::Uint8>& Reconstruction::fillHoles(const ImageBuffer<sf::Uint8>& image)
+{
+    reconstructHoles(image);
+    m_buffer = ImageBuffer<sf::Uint8>(m_marker.data(), image.width(), image.height(), 1, image.width());
+    return m_buffer;
+}
+
+// --------------------------------------------------------------------------
+const ImageBuffer<sf::Uint8>& Reconstruction::clearBorder(const ImageBuffer<sf::Uint8>& image)
+{
+    reconstructBorder(image);
+    m_buffer = ImageBuffer<sf::Uint8>(m_marker.data(), image.width(), image.height(), 1, image.width());
+    return m_buffer;
+}
+
+// --------------------------------------------------------------------------
+const sf::Image& Reconstruction::getResultAsImage()
+{
+    return m_image;
+}
@@ -0,0 +1,81 @@
+#ifndef RECONSTRUCTION_HPP
+#define RECONSTRUCTION_HPP
+
+#include <SFML/Graphics.hpp>
+
+#include "imageBuffer.hpp"
+#include "morphology.hpp"
+
+#include <deque>
+
+// --------------------------------------------------------------------------
+// Helper class - geodesic reconstruction of 8 bits images (red channel) with
+// Vincent's hybrid algorithm : a raster and an anti-raster scan then a FIFO
+// propagation of the remaining pixels, instead of elementary dilations
+// iterated until stability.
+class Reconstruction
+{
+public:
+
+    enum Connectivity
+    {
+        Four = 4,
+        Eight = 8
+    };
+
+    Reconstruction();
+    virtual ~Reconstruction();
+
+    void initialize();
+    void cleanup();
+
+    // neighborhood of the propagation (8-connectivity by default)
+    void setConnectivity(Connectivity connectivity);
+
+    // reconstruction by dilation (marker below the mask) or by erosion (marker above the mask).
+    // Other morphology types, or a marker and a mask of different sizes, give an empty result
+    const sf::Image& apply( const sf::Image& marker, const sf::Image& mask, Morphology::MorphType t = Morphology::Dilation );
+
+    // same on row-major buffers of width*height values, the marker is replaced by the result
+    // (left unchanged for other sizes or types)
+    void process( std::vector<sf::Uint8>& marker, const std::vector<sf::Uint8>& mask,
+                  unsigned int width, unsigned int height, Morphology::MorphType t = Morphology::Dilation );
+
+    // fill the regions (dark basins in grayscale) not connected to the image border
+    const sf::Image& fillHoles( const sf::Image& image );
+
+    // remove the regions (bright domes in grayscale) connected to the image border
+    const sf::Image& clearBorder( const sf::Image& image );
+
+    // same on the first channel of buffers, single channel results sharing the result pixels
+    const ImageBuffer<sf::Uint8>& apply( const ImageBuffer<sf::Uint8>& marker, const ImageBuffer<sf::Uint8>& mask,
+                                         Morphology::MorphType t = Morphology::Dilation );
+    const ImageBuffer<sf::Uint8>& fillHoles( const ImageBuffer<sf::Uint8>& image );
+    const ImageBuffer<sf::Uint8>& clearBorder( const ImageBuffer<sf::Uint8>& image );
+
+    const std::vector<sf::Uint8>& getResult() const {return m_marker;}
+    const sf::Image& getResultAsImage();
+
+protected:
+    // first channel of a buffer
+    static void extract(const ImageBuffer<sf::Uint8>& buffer, std::vector<sf::Uint8>& values);
+
+    // results in m_marker, false (and m_marker empty) for rejected inputs
+    bool reconstruct(const ImageBuffer<sf::Uint8>& marker, const ImageBuffer<sf::Uint8>& mask, Morphology::MorphType t);
+    void reconstructHoles(const ImageBuffer<sf::Uint8>& image);
+    void reconstructBorder(const ImageBuffer<sf::Uint8>& image);
+
+    // m_marker as a grayscale image
+    void updateImage(const sf::Vector2u& size);
+
+    // marker = image on the border, 0 inside
+    void borderMarker(const std::vector<sf::Uint8>& image, unsigned int width, unsigned int height);
+
+    Connectivity m_connectivity;
+    std::vector<sf::Uint8> m_marker, m_mask;
+    std::deque<unsigned int> m_queue;   // FIFO of the propagation
+    sf::Image m_image;
+    ImageBuffer<sf::Uint8> m_buffer;    // view of m_marker
+};
+
+#endif // RECONSTRUCTION_HPP
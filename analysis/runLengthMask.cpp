@@ -0,0 +1,259 @@
+#include "runLengthMask.hpp"
+
+#include <algorithm>
+
+// --------------------------------------------------------------------------
+RunLengthMask::RunLengthMask()
+{
+    create(sf::Vector2u(0,0));
+}
+
+// --------------------------------------------------------------------------
+RunLengthMask::~RunLengthMask()
+{
+}
+
+// --------------------------------------------------------------------------
+void RunLengthMask::create(const sf::Vector2u& size)
+{
+    m_size = size;
+    m_runs.clear();
+    m_rows.assign(size.y+1, 0);
+}
+
+// --------------------------------------------------------------------------
+void RunLengthMask::encode(const sf::Image& image, sf::Uint8 threshold)
+{
+    encode(imageView(image), threshold);
+}
+
+// --------------------------------------------------------------------------
+void RunLengthMask::encode(const std::vector<sf::Uint8>& mask, const sf::Vector2u& size)
+{
+    encode(ImageBuffer<sf::Uint8>(const_cast<sf::Uint8*>(mask.data()), size.x, size.y, 1, size.x), 0);
+}
+
+// --------------------------------------------------------------------------
+void RunLengthMask::encode(const ImageBuffer<sf::Uint8>& buffer, sf::Uint8 threshold)
+{
+    create(buffer.size());
+    int w = m_size.x, h = m_size.y, ch = buffer.channels();
+
+    for(int y=0;y<h;++y)
+    {
+        m_rows[y] = m_runs.size();
+        const sf::Uint8* row = buffer.row(y);
+        for(int x=0;x<w;)
+        {
+            if(row[x*ch] <= threshold) { ++x; continue; }
+
+            Run r; r.x = x; r.label = 0;
+            while(x<w && row[x*ch] > threshold) ++x;
+            r.end = x;
+            m_runs.push_back(r);
+        }
+    }
+    m_rows[h] = m_runs.size();
+}
+
+// --------------------------------------------------------------------------
+void RunLengthMask::decode(std::vector<sf::Uint8>& mask) const
+{
+    mask.assign(m_size.x*m_size.y, 0);
+    for(unsigned int y=0;y<m_size.y;++y)
+        for(unsigned int i=rowBegin(y);i<rowEnd(y);++i)
+            std::fill(mask.begin()+y*m_size.x+m_runs[i].x, mask.begin()+y*m_size.x+m_runs[i].end, 1);
+}
+
+// --------------------------------------------------------------------------
+void RunLengthMask::decodeLabels(std::vector<unsigned int>& labels) const
+{
+    labels.assign(m_size.x*m_size.y, 0);
+    for(unsigned int y=0;y<m_size.y;++y)
+        for(unsigned int i=rowBegin(y);i<rowEnd(y);++i)
+        {
+            unsigned int l = m_runs[i].label == 0 ? 1 : m_runs[i].label;
+            std::fill(labels.begin()+y*m_size.x+m_runs[i].x, labels.begin()+y*m_size.x+m_runs[i].end, l);
+        }
+}
+
+// --------------------------------------------------------------------------
+void RunLengthMask::decode(sf::Image& image) const
+{
+    std::vector<sf::Uint8> mask;
+    decode(mask);
+
+    std::vector<sf::Uint8> pixels(mask.size()*4);
+    for(unsigned int i=0;i<mask.size();++i)
+    {
+        sf::Uint8 v = mask[i] ? 255 : 0;
+        pixels[i*4] = v; pixels[i*4+1] = v; pixels[i*4+2] = v; pixels[i*4+3] = 255;
+    }
+    image.create(m_size.x, m_size.y, pixels.data());
+}
+
+// --------------------------------------------------------------------------
+void RunLengthMask::decode(ImageBuffer<sf::Uint8>& buffer) const
+{
+    buffer.create(m_size.x, m_size.y, 1);
+    buffer.fill(0);
+    for(unsigned int y=0;y<m_size.y;++y)
+        for(unsigned int i=rowBegin(y);i<rowEnd(y);++i)
+            std::fill(buffer.row(y)+m_runs[i].x, buffer.row(y)+m_runs[i].end, 255);
+}
+
+// --------------------------------------------------------------------------
+int RunLengthMask::find(int x, int y) const
+{
+    if(x<0 || y<0 || x>=(int)m_size.x || y>=(int)m_size.y) return -1;
+
+    // first run ending after x
+    auto first = m_runs.begin()+rowBegin(y), last = m_runs.begin()+rowEnd(y);
+    auto it = std::upper_bound(first, last, x, [](int v, const Run& r){return v < r.end;});
+    if(it == last || it->x > x) return -1;
+    return it - m_runs.begin();
+}
+
+// --------------------------------------------------------------------------
+bool RunLengthMask::contains(int x, int y) const
+{
+    return find(x,y) >= 0;
+}
+
+// --------------------------------------------------------------------------
+unsigned int RunLengthMask::label(int x, int y) const
+{
+    int i = find(x,y);
+    return i<0 ? 0 : m_runs[i].label;
+}
+
+// --------------------------------------------------------------------------
+unsigned int RunLengthMask::area() const
+{
+    unsigned int n = 0;
+    for(const Run& r : m_runs) n += r.end - r.x;
+    return n;
+}
+
+// --------------------------------------------------------------------------
+unsigned int RunLengthMask::area(unsigned int label) const
+{
+    unsigned int n = 0;
+    for(const Run& r : m_runs) if(r.label == label) n += r.end - r.x;
+    return n;
+}
+
+// --------------------------------------------------------------------------
+unsigned int RunLengthMask::area(const sf::IntRect& rect) const
+{
+    int x0 = std::max(rect.left, 0), x1 = std::min(rect.left+rect.width, (int)m_size.x);
+    int y0 = std::max(rect.top, 0), y1 = std::min(rect.top+rect.height, (int)m_size.y);
+
+    unsigned int n = 0;
+    for(int y=y0;y<y1;++y)
+        for(unsigned int i=rowBegin(y);i<rowEnd(y);++i)
+        {
+            int a = std::max(m_runs[i].x, x0), b = std::min(m_runs[i].end, x1);
+            if(a < b) n += b-a;
+        }
+    return n;
+}
+
+// --------------------------------------------------------------------------
+void RunLengthMask::mergeRow(std::vector<Run>& row, std::vector<Run>& runs)
+{
+    std::sort(row.begin(), row.end(), [](const Run& a, const Run& b){return a.x < b.x;});
+
+    unsigned int first = runs.size();
+    for(const Run& r : row)
+    {
+        if(runs.size() > first && r.x <= runs.back().end) runs.back().end = std::max(runs.back().end, r.end);
+        else { Run n = r; n.label = 0; runs.push_back(n); }
+    }
+}
+
+// --------------------------------------------------------------------------
+void RunLengthMask::dilate(int rx, int ry, RunLengthMask& result) const
+{
+    int w = m_size.x, h = m_size.y;
+
+    // horizontal pass : runs grown by rx (merged ones are kept sorted by mergeRow)
+    RunLengthMask horizontal;
+    horizontal.create(m_size);
+    std::vector<Run> row;
+    for(int y=0;y<h;++y)
+    {
+        horizontal.m_rows[y] = horizontal.m_runs.size();
+        row.clear();
+        for(unsigned int i=rowBegin(y);i<rowEnd(y);++i)
+        {
+            Run r = m_runs[i];
+            r.x = std::max(r.x-rx, 0); r.end = std::min(r.end+rx, w);
+            row.push_back(r);
+        }
+        mergeRow(row, horizontal.m_runs);
+    }
+    horizontal.m_rows[h] = horizontal.m_runs.size();
+
+    // vertical pass : union of the 2*ry+1 rows around
+    result.create(m_size);
+    for(int y=0;y<h;++y)
+    {
+        result.m_rows[y] = result.m_runs.size();
+        row.clear();
+        for(int k=std::max(y-ry,0);k<=std::min(y+ry,h-1);++k)
+            row.insert(row.end(), horizontal.m_runs.begin()+horizontal.rowBegin(k), horizontal.m_runs.begin()+horizontal.rowEnd(k));
+        mergeRow(row, result.m_runs);
+    }
+    result.m_rows[h] = result.m_runs.size();
+}
+
+// --------------------------------------------------------------------------
+void RunLengthMask::erode(int rx, int ry, RunLengthMask& result) const
+{
+    int w = m_size.x, h = m_size.y;
+
+    // horizontal pass : runs shrunk by rx, except on the image borders (replicated)
+    RunLengthMask horizontal;
+    horizontal.create(m_size);
+    for(int y=0;y<h;++y)
+    {
+        horizontal.m_rows[y] = horizontal.m_runs.size();
+        for(unsigned int i=rowBegin(y);i<rowEnd(y);++i)
+        {
+            Run r = m_runs[i];
+            r.label = 0;
+            if(r.x > 0) r.x += rx;
+            if(r.end < w) r.end -= rx;
+            if(r.x < r.end) horizontal.m_runs.push_back(r);
+        }
+    }
+    horizontal.m_rows[h] = horizontal.m_runs.size();
+
+    // vertical pass : intersection of the 2*ry+1 rows around, clamped rows being the border ones
+    result.create(m_size);
+    std::vector<Run> curr, next;
+    for(int y=0;y<h;++y)
+    {
+        result.m_rows[y] = result.m_runs.size();
+
+        int k0 = std::max(y-ry,0), k1 = std::min(y+ry,h-1);
+        curr.assign(horizontal.m_runs.begin()+horizontal.rowBegin(k0), horizontal.m_runs.begin()+horizontal.rowEnd(k0));
+        for(int k=k0+1;k<=k1 && !curr.empty();++k)
+        {
+            next.clear();
+            unsigned int i = 0, j = horizontal.rowBegin(k), jend = horizontal.rowEnd(k);
+            while(i<curr.size() && j<jend)
+            {
+                const Run& a = curr[i];
+                const Run& b = horizontal.m_runs[j];
+                Run r; r.x = std::max(a.x, b.x); r.end = std::min(a.end, b.end); r.label = 0;
+                if(r.x < r.end) next.push_back(r);
+                if(a.end < b.end) ++i; else ++j;
+            }
+            curr.swap(next);
+        }
+        result.m_runs.insert(result.m_runs.end(), curr.begin(), curr.end());
+    }
+    result.m_rows[h] = result.m_runs.size();
+}
@@ -0,0 +1,76 @@
+#ifndef RUN_LENGTH_MASK_HPP
+#define RUN_LENGTH_MASK_HPP
+
+#include <SFML/Graphics.hpp>
+
+#include "imageBuffer.hpp"
+
+// --------------------------------------------------------------------------
+// Helper class - binary mask (or label map) stored as runs of set pixels per row.
+// Runs of a row are sorted and disjoint, rows are stored in order.
+class RunLengthMask
+{
+public:
+
+    struct Run
+    {
+        int x, end;             // pixels [x,end) of the row
+        unsigned int label;     // 0 until labeled (see BlobAnalysis)
+    };
+
+    RunLengthMask();
+    virtual ~RunLengthMask();
+
+    // empty mask of the given size
+    void create(const sf::Vector2u& size);
+
+    // set pixels : red channel above the threshold
+    void encode(const sf::Image& image, sf::Uint8 threshold = 127);
+    // set pixels : non zero values (row-major)
+    void encode(const std::vector<sf::Uint8>& mask, const sf::Vector2u& size);
+    // set pixels : first channel above the threshold
+    void encode(const ImageBuffer<sf::Uint8>& buffer, sf::Uint8 threshold = 127);
+
+    // 0/1 per pixel, row-major
+    void decode(std::vector<sf::Uint8>& mask) const;
+    // label (or 1 when unlabeled) per pixel, row-major
+    void decodeLabels(std::vector<unsigned int>& labels) const;
+    // white on black image
+    void decode(sf::Image& image) const;
+    // single channel, 255 for set pixels
+    void decode(ImageBuffer<sf::Uint8>& buffer) const;
+
+    // runs of the row y are [rowBegin(y), rowEnd(y))
+    unsigned int rowBegin(int y) const {return m_rows[y];}
+    unsigned int rowEnd(int y) const {return m_rows[y+1];}
+
+    const std::vector<Run>& runs() const {return m_runs;}
+    Run& run(unsigned int i) {return m_runs[i];}
+    unsigned int runCount() const {return m_runs.size();}
+    const sf::Vector2u& size() const {return m_size;}
+
+    // queries
+    bool contains(int x, int y) const;
+    unsigned int label(int x, int y) const;     // 0 outside the mask
+    unsigned int area() const;
+    unsigned int area(unsigned int label) const;
+    unsigned int area(const sf::IntRect& rect) const;
+
+    // morphology with a (2*rx+1)x(2*ry+1) rectangle, borders replicated like the texture samplers.
+    // Labels are not kept
+    void dilate(int rx, int ry, RunLengthMask& result) const;
+    void erode(int rx, int ry, RunLengthMask& result) const;
+
+protected:
+    // index of the run of row y containing x, or -1
+    int find(int x, int y) const;
+
+    // append the runs of a row to the result, merging the overlapping or adjacent ones
+    static void mergeRow(std::vector<Run>& row, std::vector<Run>& runs);
+
+    sf::Vector2u m_size;
+    std::vector<Run> m_runs;            // all runs, row after row
+    std::vector<unsigned int> m_rows;   // first run of each row (+ end)
+};
+
+#endif // RUN_LENGTH_MASK_HPP
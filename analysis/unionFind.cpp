@@ -0,0 +1,55 @@
+#include "unionFind.hpp"
+
+#include <utility>
+
+// --------------------------------------------------------------------------
+UnionFind::UnionFind()
+    : _capacity(0)
+{
+}
+
+// --------------------------------------------------------------------------
+UnionFind::~UnionFind()
+{
+}
+
+// --------------------------------------------------------------------------
+void UnionFind::reset(unsigned int capacity)
+{
+    if(capacity <= _capacity) return;
+
+    _parent.reset(new std::atomic<unsigned int>[capacity]);
+    _capacity = capacity;
+}
+
+// --------------------------------------------------------------------------
+unsigned int UnionFind::find(unsigned int i)
+{
+    // path halving : a parent is only ever replaced by one of its ancestors,
+    // which stays valid while other workers link roots
+    while(true)
+    {
+        unsigned int p = _parent[i].load(std::memory_order_relaxed);
+        if(p == i) return i;
+
+        unsigned int gp = _parent[p].load(std::memory_order_relaxed);
+        if(gp != p) _parent[i].store(gp, std::memory_order_relaxed);
+        i = gp;
+    }
+}
+
+// --------------------------------------------------------------------------
+unsigned int UnionFind::unite(unsigned int a, unsigned int b)
+{
+    while(true)
+    {
+        a = find(a);
+        b = find(b);
+        if(a == b) return a;
+
+        // link the larger root under the smaller one, retry if it stopped being a root
+        if(a < b) std::swap(a,b);
+        unsigned int expected = a;
+        if(_parent[a].compare_exchange_weak(expected, b, std::memory_order_acq_rel)) return b;
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef UNION_FIND_HPP
+#define UNION_FIND_HPP
+
+#include <atomic>
+#include <memory>
+
+// --------------------------------------------------------------------------
+// Helper class - disjoint sets over [0,capacity). The root of a set is its
+// smallest element, so the result doesn't depend on the merge order.
+// unite() is lock-free : workers can merge sets concurrently.
+class UnionFind
+{
+public:
+    UnionFind();
+    virtual ~UnionFind();
+
+    // make room for elements [0,capacity), they are created by makeSet()
+    void reset(unsigned int capacity);
+    void makeSet(unsigned int i) { _parent[i].store(i, std::memory_order_relaxed); }
+
+    unsigned int find(unsigned int i);
+
+    // merge the sets of a and b, returns the root of the union
+    unsigned int unite(unsigned int a, unsigned int b);
+
+    unsigned int capacity() const {return _capacity;}
+
+protected:
+    std::unique_ptr<std::atomic<unsigned int>[]> _parent;
+    unsigned int _capacity;
+};
+
+#endif // UNION_FIND_HPP
@@ -14,6 +14,9 @@ int main(int argc, char* argv[])
     std::vector<std::string> args;
     if(argc>1) args = std::vector<std::string>(argv+1,argv+argc);
 
+    // run the filters on CPU (hosts without GPU)
+    for(const auto& arg : args) if(arg == "--cpu") Filter::setDefaultBackend(Filter::CPU);
+
     sf::RenderWindow win(sf::VideoMode(1024, 768), "Image Analysis with SFML", sf::Style::Default, sf::ContextSettings(24));
     win.setFramerateLimit(60);
 